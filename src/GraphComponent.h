@@ -31,8 +31,13 @@
 
 //#include "mammut.h"
 extern void BlitWin(Graphics *g);
+extern void GUI_mouseDown(int x);
+extern void GUI_mouseDrag(int x);
+extern void GUI_mouseWheel(int x,float increment);
+extern void GUI_mouseDoubleClick(void);
 
-class GraphComponent  : public Component
+class GraphComponent  : public Component,
+                        public AsyncUpdater
 {
 public:
   //==============================================================================
@@ -67,6 +72,33 @@ public:
   {    
     BlitWin(&g);
   }
+
+  // The spectrum renderer has a new image.
+  void handleAsyncUpdate ()
+  {
+    repaint();
+  }
+
+  // Drag to scroll, wheel to zoom, double-click to show everything.
+  void mouseDown (const MouseEvent& e)
+  {
+    GUI_mouseDown(e.x);
+  }
+
+  void mouseDrag (const MouseEvent& e)
+  {
+    GUI_mouseDrag(e.x);
+  }
+
+  void mouseWheelMove (const MouseEvent& e, float wheelIncrementX, float wheelIncrementY)
+  {
+    GUI_mouseWheel(e.x,wheelIncrementY);
+  }
+
+  void mouseDoubleClick (const MouseEvent& e)
+  {
+    GUI_mouseDoubleClick();
+  }
   //==============================================================================
   
 private:
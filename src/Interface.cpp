@@ -37,8 +37,42 @@
 static uint32 paintduration=0;
 static uint32 lastrepaint=0;
 
+// Time between animation frames. After each paint of the picture it moves towards
+// five times the time the paint took, so the animation uses at most about a fifth of a core.
+#define MINFRAMEINTERVAL 20
+#define MAXFRAMEINTERVAL 1000
+static uint32 frameinterval=MINFRAMEINTERVAL;
+
+// The moving camera's view of the picture, scaled up to 872x738 once,
+// so that painting it is a plain blit until the camera moves.
+static Image *cameraframe=NULL;
+static Image *cameraframe_picture=NULL;
+static int cameraframe_x, cameraframe_y, cameraframe_x2, cameraframe_y2;
+
+static Image *getCameraFrame(Image *picture,int x,int y,int x2,int y2){
+  if(cameraframe==NULL)
+    cameraframe=new Image(Image::RGB,872,738,false);
+
+  if(picture!=cameraframe_picture || x!=cameraframe_x || y!=cameraframe_y || x2!=cameraframe_x2 || y2!=cameraframe_y2){
+    Graphics g(*cameraframe);
+    g.setImageResamplingQuality(Graphics::lowResamplingQuality);
+    g.drawImage(picture,
+		0, 0, 872, 738,
+		x,y,x2-x,y2-y,
+		false);
+    cameraframe_picture=picture;
+    cameraframe_x=x;
+    cameraframe_y=y;
+    cameraframe_x2=x2;
+    cameraframe_y2=y2;
+  }
+
+  return cameraframe;
+}
+
 
 extern void GUI_init(GraphComponent *das_graphcomponent,Interface *das_interface);
+extern void GUI_exit(void);
 
 class DasTabbedComponent  : public TabbedComponent
 {
@@ -405,7 +439,7 @@ Interface::Interface (DocumentWindow *mainwindow, const String& commandLine)
     pic_y=5;
     pic_x2=872-15;
     pic_y2=738-15;
-    internalCachedImage3=PictureHolder::getImage(0);
+    internalCachedImage3=NULL; // Set by timerCallback when the picture has been decoded.
 
 
 #if 0
@@ -436,6 +470,10 @@ Interface::~Interface()
     //[Destructor_pre]. You can add your own custom destruction code here..
   printf("exitgakk0 %d\n",sizeof(float));
   printf("exitgakk\n");
+  GUI_exit();
+  PictureHolder::stopDecoding();
+  internalCachedImage3=NULL;
+  deleteAndZero(cameraframe);
     //[/Destructor_pre]
 
     deleteAndZero (groupComponent5);
@@ -523,23 +561,27 @@ void Interface::paint (Graphics& g)
     }
 
     g.setImageResamplingQuality(Graphics::lowResamplingQuality);
-    if(prefs_picture==true){
+    if(prefs_picture==true && internalCachedImage3==NULL){
+      // A shade where the picture will be, until it has been decoded.
+      g.setColour (Colours::black.withAlpha (0.0800f));
+      g.fillRect (0, 0, 872, 738);
+      lastrepaint=Time::getMillisecondCounter();
+    }else if(prefs_picture==true && g.clipRegionIntersects(0,0,872,738)){
       g.setColour (Colours::black.withAlpha (0.2700f));
       if(prefs_movingcamera==true){
 #if 0
 	g.drawImageAt(tempimage,0,0,false);
 #else
-	g.drawImage(internalCachedImage3,
-		    0, 0, 872, 738,
-		    pic_x,pic_y,pic_x2-pic_x,pic_y2-pic_y,
-		    false);
+	g.drawImageAt(getCameraFrame(internalCachedImage3,pic_x,pic_y,pic_x2,pic_y2),0,0,false);
 #endif
       }else{
 	g.drawImageAt(internalCachedImage3,0,0,false);
       }
-    }
-    lastrepaint=Time::getMillisecondCounter();
-    paintduration=lastrepaint-starttime;
+      lastrepaint=Time::getMillisecondCounter();
+      paintduration=lastrepaint-starttime;
+      frameinterval=jlimit((uint32)MINFRAMEINTERVAL,(uint32)MAXFRAMEINTERVAL,(frameinterval*3+paintduration*5)/4);
+    }else
+      lastrepaint=Time::getMillisecondCounter();
 #endif
 #if 0
     GradientBrush gb (Colour((juce::uint8)0xcd,(juce::uint8)0xd1,(juce::uint8)0xce,(juce::uint8)0xee),
@@ -1089,11 +1131,6 @@ void Interface::run(){
 
 void Interface::timerCallback(){
   static bool wasplaying=false;
-  static Image *ims[3]={
-    PictureHolder::getImage(0),
-    PictureHolder::getImage(1),
-    PictureHolder::getImage(2)
-  };
   static Random *random=new Random(Time::currentTimeMillis());
 
 #if 1
@@ -1112,10 +1149,8 @@ void Interface::timerCallback(){
 
    //printf("time-lastrepaint: %d, paintduration: %d, dtime: %d\n",time-lastrepaint,paintduration,paintduration-2*(time-lastrepaint));
 
-  // Don't want the animation-stuff to stall the computer.
-  if(time-lastrepaint<10 || (time-lastrepaint)<paintduration){
-    return;
-  }
+  // Don't want the animation-stuff to stall the computer, or to take time from processing and playing.
+  bool animate = isprocessing==false && jp_isplaying==false && time-lastrepaint>=frameinterval;
 
   if(jp_isplaying){
     double playpos=256.0;
@@ -1151,7 +1186,14 @@ void Interface::timerCallback(){
     }
   }
 
-  if(isprocessing==false && prefs_picture==true && prefs_movingcamera==true){
+  // The pictures are decoded in the background, the first time one is asked for.
+  if(prefs_picture==true && internalCachedImage3==NULL){
+    internalCachedImage3=PictureHolder::getImage(0);
+    if(internalCachedImage3!=NULL)
+      mustpaint=true;
+  }
+
+  if(animate && prefs_picture==true && prefs_movingcamera==true && internalCachedImage3!=NULL){
     static uint32 nexttime2=0;
     if(1 || time>=nexttime2){
       static int addval_x=0;
@@ -1217,12 +1259,12 @@ void Interface::timerCallback(){
   }
 
 
-  if(isprocessing==false && prefs_picture==true && prefs_animation==true){
+  if(animate && prefs_picture==true && prefs_animation==true && internalCachedImage3!=NULL){
     static uint32 nexttime=0;
     if(time>=nexttime){
       for(int i=0;i<1000;i++){
-	Image *newim=ims[random->nextInt(3)];
-	if(newim!=internalCachedImage3){
+	Image *newim=PictureHolder::getImage(random->nextInt(3));
+	if(newim!=NULL && newim!=internalCachedImage3){
 	  internalCachedImage3=newim;
 	  mustpaint=true;
 	  break;
@@ -1232,8 +1274,9 @@ void Interface::timerCallback(){
     }
   }
 
+  // Only the picture has changed.
   if(mustpaint==true){
-      repaint();
+      repaint(0,0,872,738);
   }
 }
 
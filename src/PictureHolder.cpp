@@ -18,6 +18,14 @@
 */
 
 //[Headers] You can add your own extra header files here...
+#include "mammut.h"
+#include "spectrumcache.h"
+
+#include <limits.h>
+
+#ifndef _WIN32
+#  include <unistd.h>
+#endif
 //[/Headers]
 
 #include "PictureHolder.h"
@@ -62,6 +70,199 @@ void PictureHolder::resized()
 
 
 //[MiscUserCode] You can add your own definitions of your custom methods or any other code here...
+
+/*
+  The pictures are decoded by a background thread, which is started the
+  first time getImage is called. So nothing is decoded unless a picture
+  is shown, and getImage returns NULL until the picture is ready.
+
+  A decoded picture is written to <cachedir>/picture<num>-<hash>.pixels
+  (the directory of the spectrum cache), so later starts only read the
+  pixels. The hash is of the jpeg, so a changed picture gets a new file,
+  and the old one is eventually removed by the trimming of the cache.
+  The file starts with a PH_HEADERSIZE bytes text header with the size
+  and pixel format of the image, and the rows follow.
+*/
+
+#define PH_HEADERSIZE 64
+
+#ifndef PATH_MAX
+#  define PATH_MAX 1024
+#endif
+#define PH_NAMELEN (PATH_MAX+64)
+
+static CriticalSection picturelock;
+static Image *pictures[3]={NULL,NULL,NULL};
+static bool stopped=false;
+
+
+#ifdef _WIN32
+
+static Image *PH_readCache(const char *cachename){
+  return NULL;
+}
+
+static void PH_writeCache(const char *cachename,Image *image){
+}
+
+#else
+
+static Image *PH_readCache(const char *cachename){
+  char header[PH_HEADERSIZE];
+  int width,height,format,pixelstride;
+  int linestride,stride;
+  uint8 *pixels;
+  Image *image;
+  bool ok;
+  int y;
+  FILE *file=fopen(cachename,"rb");
+
+  if(file==NULL)
+    return NULL;
+
+  if(fread(header,1,PH_HEADERSIZE,file)!=PH_HEADERSIZE
+     || sscanf(header,"mammutpicture 1 %d %d %d %d",&width,&height,&format,&pixelstride)!=4
+     || width<=0 || height<=0
+     || (format!=Image::RGB && format!=Image::ARGB)){
+    fclose(file);
+    return NULL;
+  }
+
+  image=new Image((Image::PixelFormat)format,width,height,false);
+
+  pixels=image->lockPixelDataReadWrite(0,0,width,height,linestride,stride);
+  ok=stride==pixelstride;
+  for(y=0;ok && y<height;y++)
+    ok=fread(pixels+y*linestride,stride,width,file)==(size_t)width;
+  image->releasePixelDataReadWrite(pixels);
+
+  fclose(file);
+
+  if(ok==false){
+    delete image;
+    return NULL;
+  }
+
+  return image;
+}
+
+static void PH_writeCache(const char *cachename,Image *image){
+  char header[PH_HEADERSIZE];
+  char tempname[PH_NAMELEN+16];
+  int width=image->getWidth();
+  int height=image->getHeight();
+  int linestride,stride;
+  const uint8 *pixels;
+  bool ok;
+  int y;
+  int fd;
+
+  /* Written to a temporary file first (see spectrumcache.c), so that a cache file is never half written. */
+  fd=SC_openTemp(cachename,tempname,sizeof(tempname));
+  if(fd==-1)
+    return;
+
+  pixels=image->lockPixelDataReadOnly(0,0,width,height,linestride,stride);
+
+  memset(header,0,PH_HEADERSIZE);
+  snprintf(header,PH_HEADERSIZE,"mammutpicture 1 %d %d %d %d\n",width,height,(int)image->getFormat(),stride);
+  ok=write(fd,header,PH_HEADERSIZE)==PH_HEADERSIZE;
+  for(y=0;ok && y<height;y++)
+    ok=write(fd,pixels+y*linestride,width*stride)==(ssize_t)(width*stride);
+
+  image->releasePixelDataReadOnly(pixels);
+
+  if(SC_closeTemp(fd,tempname,cachename,ok)==false)
+    fprintf(stderr,"Could not write %s to the cache.\n",cachename);
+}
+
+#endif
+
+
+static bool PH_getCacheName(int num,const char *jpeg,int size,char *cachename,int len){
+  char dir[PATH_MAX];
+  unsigned long long hash=14695981039346656037ULL;
+  int i;
+
+  if(SC_getDir(dir,sizeof(dir))==false)
+    return false;
+
+  for(i=0;i<size;i++){
+    hash^=(unsigned char)jpeg[i];
+    hash*=1099511628211ULL;
+  }
+
+  return snprintf(cachename,len,"%s/picture%d-%016llx.pixels",dir,num,hash)<len;
+}
+
+
+class PictureDecoder : public Thread
+{
+public:
+  PictureDecoder() : Thread(T("picturedecoder")) {
+  }
+
+  void run()
+  {
+    const char *jpegs[3]={PictureHolder::mammut_zerlegen2_jpg,PictureHolder::mammut_zerlegen3_jpg,PictureHolder::mammut_zerlegen4_jpg};
+    const int sizes[3]={PictureHolder::mammut_zerlegen2_jpgSize,PictureHolder::mammut_zerlegen3_jpgSize,PictureHolder::mammut_zerlegen4_jpgSize};
+
+    for(int num=0;num<3 && threadShouldExit()==false;num++){
+      char cachename[PH_NAMELEN];
+      bool cache=PH_getCacheName(num,jpegs[num],sizes[num],cachename,sizeof(cachename));
+      Image *image=NULL;
+
+      if(cache==true)
+	image=PH_readCache(cachename);
+
+      if(image==NULL){
+	image=ImageFileFormat::loadFrom(jpegs[num],sizes[num]);
+	if(image!=NULL && cache==true)
+	  PH_writeCache(cachename,image);
+      }
+
+      picturelock.enter();
+      pictures[num]=image;
+      picturelock.exit();
+    }
+  }
+};
+
+static PictureDecoder *decoder=NULL;
+
+
+Image *PictureHolder::getImage(int num){
+  Image *image;
+
+  picturelock.enter();
+  if(decoder==NULL && stopped==false){
+    decoder=new PictureDecoder();
+    decoder->startThread();
+  }
+  image=pictures[num];
+  picturelock.exit();
+
+  return image;
+}
+
+// Called before exit. Stops the decoding, if it is still going on, and frees the pictures.
+// After this, getImage only returns NULL.
+void PictureHolder::stopDecoding(void){
+  int num;
+
+  if(decoder!=NULL){
+    decoder->stopThread(5000);
+    delete decoder;
+    decoder=NULL;
+  }
+
+  picturelock.enter();
+  stopped=true;
+  for(num=0;num<3;num++)
+    deleteAndZero(pictures[num]);
+  picturelock.exit();
+}
+
 //[/MiscUserCode]
 
 
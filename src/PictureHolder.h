@@ -43,13 +43,10 @@ public:
 
     //==============================================================================
     //[UserMethods]     -- You can add your own custom methods in this section.
-    static Image *getImage(int num){
-      static Image *images[3]={ImageFileFormat::loadFrom(mammut_zerlegen2_jpg, mammut_zerlegen2_jpgSize),
-			       ImageFileFormat::loadFrom(mammut_zerlegen3_jpg, mammut_zerlegen3_jpgSize),
-			       ImageFileFormat::loadFrom(mammut_zerlegen4_jpg, mammut_zerlegen4_jpgSize)};
-
-      return images[num];
-    }
+    // Returns picture num (0-2), or NULL if it is not decoded yet.
+    // The first call starts decoding the pictures in the background.
+    static Image *getImage(int num);
+    static void stopDecoding(void);
     //[/UserMethods]
 
     void paint (Graphics& g);
@@ -34,6 +34,9 @@ Prefs::Prefs ()
       animationButton (0),
       pictureButton (0),
       loopButton (0),
+      spectrumondiskButton (0),
+      preresampleButton (0),
+      previewButton (0),
       audioSettingsButton (0)
 {
     addAndMakeVisible (soundonoffButton = new ToggleButton (T("new toggle button")));
@@ -61,12 +64,26 @@ Prefs::Prefs ()
     loopButton->addButtonListener (this);
     loopButton->setToggleState (true, false);
 
+    addAndMakeVisible (spectrumondiskButton = new ToggleButton (T("new toggle button")));
+    spectrumondiskButton->setButtonText (T("Spectrum on Disk"));
+    spectrumondiskButton->addButtonListener (this);
+
+    addAndMakeVisible (preresampleButton = new ToggleButton (T("new toggle button")));
+    preresampleButton->setButtonText (T("Resample before playing"));
+    preresampleButton->setTooltip (T("When the soundcard runs at another samplerate than the sound, resample the whole sound before playing instead of while playing. Starts slower, but uses less cpu while playing."));
+    preresampleButton->addButtonListener (this);
+
+    addAndMakeVisible (previewButton = new ToggleButton (T("new toggle button")));
+    previewButton->setButtonText (T("Fast preview"));
+    previewButton->setTooltip (T("Play a low samplerate preview of large spectra right away, while the full sound is made in the background."));
+    previewButton->addButtonListener (this);
+
     addAndMakeVisible (audioSettingsButton = new TextButton (T("new button")));
     audioSettingsButton->setButtonText (T("Audio Settings"));
     audioSettingsButton->addButtonListener (this);
     audioSettingsButton->setColour (TextButton::buttonColourId, Colour (0x21bbbbff));
 
-    setSize (200, 230);
+    setSize (200, 326);
 
     //[Constructor] You can add your own custom stuff here..
     propertiesfile=PropertiesFile::createDefaultAppPropertiesFile("mammut",".prefs",String::empty,false,0,PropertiesFile::storeAsXML);
@@ -79,6 +96,9 @@ Prefs::Prefs ()
     movingcameraButton->setToggleState(propertiesfile->getBoolValue(movingcameraButton->getButtonText().replaceCharacters(String(" "),String("_")),true),true);
     animationButton->setToggleState(propertiesfile->getBoolValue(animationButton->getButtonText().replaceCharacters(String(" "),String("_")),true),true);
     loopButton->setToggleState(propertiesfile->getBoolValue(loopButton->getButtonText().replaceCharacters(String(" "),String("_")),true),true);
+    spectrumondiskButton->setToggleState(propertiesfile->getBoolValue(spectrumondiskButton->getButtonText().replaceCharacters(String(" "),String("_")),false),true);
+    preresampleButton->setToggleState(propertiesfile->getBoolValue(preresampleButton->getButtonText().replaceCharacters(String(" "),String("_")),false),true);
+    previewButton->setToggleState(propertiesfile->getBoolValue(previewButton->getButtonText().replaceCharacters(String(" "),String("_")),true),true);
     //[/Constructor]
 }
 
@@ -92,6 +112,9 @@ Prefs::~Prefs()
     deleteAndZero (animationButton);
     deleteAndZero (pictureButton);
     deleteAndZero (loopButton);
+    deleteAndZero (spectrumondiskButton);
+    deleteAndZero (preresampleButton);
+    deleteAndZero (previewButton);
     deleteAndZero (audioSettingsButton);
 
     //[Destructor]. You can add your own custom destruction code here..
@@ -114,7 +137,10 @@ void Prefs::resized()
     animationButton->setBounds (32, 88, 150, 24);
     pictureButton->setBounds (32, 56, 150, 24);
     loopButton->setBounds (32, 152, 150, 24);
-    audioSettingsButton->setBounds (24, 192, 158, 24);
+    spectrumondiskButton->setBounds (32, 184, 150, 24);
+    preresampleButton->setBounds (32, 216, 150, 24);
+    previewButton->setBounds (32, 248, 150, 24);
+    audioSettingsButton->setBounds (24, 288, 158, 24);
     //[UserResized] Add your own custom resize handling here..
     //[/UserResized]
 }
@@ -171,6 +197,27 @@ void Prefs::buttonClicked (Button* buttonThatWasClicked)
       propertiesfile->setValue(buttonThatWasClicked->getButtonText().replaceCharacters(String(" "),String("_")),buttonThatWasClicked->getToggleState());
         //[/UserButtonCode_loopButton]
     }
+    else if (buttonThatWasClicked == spectrumondiskButton)
+    {
+        //[UserButtonCode_spectrumondiskButton] -- add your button handler code here..
+      prefs_spectrumondisk=buttonThatWasClicked->getToggleState();
+      propertiesfile->setValue(buttonThatWasClicked->getButtonText().replaceCharacters(String(" "),String("_")),buttonThatWasClicked->getToggleState());
+        //[/UserButtonCode_spectrumondiskButton]
+    }
+    else if (buttonThatWasClicked == preresampleButton)
+    {
+        //[UserButtonCode_preresampleButton] -- add your button handler code here..
+      prefs_preresample=buttonThatWasClicked->getToggleState();
+      propertiesfile->setValue(buttonThatWasClicked->getButtonText().replaceCharacters(String(" "),String("_")),buttonThatWasClicked->getToggleState());
+        //[/UserButtonCode_preresampleButton]
+    }
+    else if (buttonThatWasClicked == previewButton)
+    {
+        //[UserButtonCode_previewButton] -- add your button handler code here..
+      prefs_preview=buttonThatWasClicked->getToggleState();
+      propertiesfile->setValue(buttonThatWasClicked->getButtonText().replaceCharacters(String(" "),String("_")),buttonThatWasClicked->getToggleState());
+        //[/UserButtonCode_previewButton]
+    }
     else if (buttonThatWasClicked == audioSettingsButton)
     {
         //[UserButtonCode_audioSettingsButton] -- add your button handler code here..
@@ -201,7 +248,7 @@ BEGIN_JUCER_METADATA
 <JUCER_COMPONENT documentType="Component" className="Prefs" componentName="" parentClasses="public Component"
                  constructorParams="" variableInitialisers="" snapPixels="8" snapActive="1"
                  snapShown="1" overlayOpacity="0.330000013" fixedSize="0" initialWidth="200"
-                 initialHeight="230">
+                 initialHeight="326">
   <BACKGROUND backgroundColour="9cb1886c"/>
   <TOGGLEBUTTON name="new toggle button" memberName="soundonoffButton" pos="32 24 150 24"
                 buttonText="Startup Sound" connectedEdges="0" needsCallback="1"
@@ -217,7 +264,18 @@ BEGIN_JUCER_METADATA
   <TOGGLEBUTTON name="new toggle button" memberName="loopButton" pos="32 152 150 24"
                 buttonText="Loop playing" connectedEdges="0" needsCallback="1"
                 state="1"/>
-  <TEXTBUTTON name="new button" memberName="audioSettingsButton" pos="24 192 158 24"
+  <TOGGLEBUTTON name="new toggle button" memberName="spectrumondiskButton" pos="32 184 150 24"
+                buttonText="Spectrum on Disk" connectedEdges="0" needsCallback="1"
+                state="0"/>
+  <TOGGLEBUTTON name="new toggle button" memberName="preresampleButton" pos="32 216 150 24"
+                tooltip="When the soundcard runs at another samplerate than the sound, resample the whole sound before playing instead of while playing. Starts slower, but uses less cpu while playing."
+                buttonText="Resample before playing" connectedEdges="0" needsCallback="1"
+                state="0"/>
+  <TOGGLEBUTTON name="new toggle button" memberName="previewButton" pos="32 248 150 24"
+                tooltip="Play a low samplerate preview of large spectra right away, while the full sound is made in the background."
+                buttonText="Fast preview" connectedEdges="0" needsCallback="1"
+                state="0"/>
+  <TEXTBUTTON name="new button" memberName="audioSettingsButton" pos="24 288 158 24"
               bgColOff="21bbbbff" buttonText="Audio Settings" connectedEdges="0"
               needsCallback="1"/>
 </JUCER_COMPONENT>
@@ -66,6 +66,9 @@ private:
     ToggleButton* animationButton;
     ToggleButton* pictureButton;
     ToggleButton* loopButton;
+    ToggleButton* spectrumondiskButton;
+    ToggleButton* preresampleButton;
+    ToggleButton* previewButton;
     TextButton* audioSettingsButton;
 
     //==============================================================================
@@ -2,6 +2,7 @@
 #include "mammut.h"
 #include "juce.h"
 #include "undo.h"
+#include "dirty.h"
 
 
 static void (*func)(void)=NULL;
@@ -155,7 +156,10 @@ void GUI_newprocess(void das_func(void)){
   mytask->setProgress(0.0);
 
   func=das_func;
+
+  GUI_lockSpectrum();
   mytask->runThread();
+  GUI_unlockSpectrum();
 }
 
 
@@ -173,10 +177,16 @@ void Transformit(void das_func(void)){
 
   func=das_func;  
 
+  GUI_lockSpectrum();
+  DIRTY_begin();
+
   //cs->enter();
   mytask->runThread();
   //cs->exit();
 
+  DIRTY_end();
+  GUI_unlockSpectrum();
+
   RedrawWin();
 
   func=NULL;
@@ -189,7 +199,9 @@ void ReTransformit(void das_func(void)){
 
   MC_stop();
 
-  UNDO_do_noredraw();
+  // If the last transform could not be undone, doing this one on top of it would be wrong.
+  if(UNDO_do_noredraw()==false)
+    return;
 
   mytask->setProgress(0.0);
 
@@ -197,7 +209,12 @@ void ReTransformit(void das_func(void)){
   //GUI_addUndo();
 
   func=das_func;  
+
+  GUI_lockSpectrum();
+  DIRTY_begin();
   mytask->runThread();
+  DIRTY_end();
+  GUI_unlockSpectrum();
 
   RedrawWin();
 
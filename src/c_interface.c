@@ -9,6 +9,7 @@
 #include "undo.h"
 //#include "interface.h"
 #include "tempfile.h"
+#include "threadpool.h"
 
 //#include <Python.h>
 
@@ -104,22 +105,24 @@ void MC_redrawWin(void){
   RedrawWin();
 }
 
+// Toggles between the whole spectrum and a tenth of it.
 void MC_zoom(void){
   MC_stop();
-  zoom=zoom==0?1:0;
-  RedrawWin();
+  if(GUI_isZoomed())
+    GUI_setView(0.0,R/2.0);
+  else
+    GUI_setView(view_lowfreq,view_lowfreq+R/20.0);
 }
 
+// Scrolls half the visible width.
 void MC_left(void){
-  if(zoom==0 || leftkc==0) return;
-  leftkc--;
-  RedrawWin();
+  double width=view_highfreq-view_lowfreq;
+  GUI_setView(view_lowfreq-width/2,view_highfreq-width/2);
 }
 
 void MC_right(void){
-  if(zoom==0 || leftkc==R/2000) return;
-  leftkc++;
-  RedrawWin();
+  double width=view_highfreq-view_lowfreq;
+  GUI_setView(view_lowfreq+width/2,view_highfreq+width/2);
 }
 
 bool MC_isStereo(void){
@@ -163,6 +166,8 @@ void MC_init(void){
 #endif
   create_tempfile();
 
+  TP_init();
+
   //juceplay_init();
 
 }
@@ -0,0 +1,140 @@
+
+#include "mammut.h"
+
+#include "dirty.h"
+#include "render.h"
+#include "magpyramid.h"
+#include "undo.h"
+
+
+/*
+  Every change of lyd is put between DIRTY_begin and DIRTY_end. In between,
+  the change may report the values it has touched with DIRTY_add, as
+  ranges [start,end) of the N values of a channel. If nothing is reported,
+  the whole spectrum is dirty, so changes which don't report anything
+  (most transforms, load) are handled like before. DIRTY_all is a change
+  of the whole spectrum, or of its size.
+
+  DIRTY_end tells the caches of the spectrum (the sound in render.c, the
+  magnitude pyramid and undo), which can ask for the ranges with
+  DIRTY_getNumRanges and DIRTY_getRange until the next DIRTY_begin.
+
+  Each channel keeps at most DIRTY_MAXRANGES ranges. Overlapping and
+  adjacent ranges are joined, and when there are too many, the two
+  closest ranges are joined too, so the ranges may cover a bit more
+  than what was touched.
+
+  DIRTY_add is not thread-safe. It should be called from the transform
+  itself, not from the jobs it gives to TP_run.
+*/
+
+
+#define DIRTY_MAXRANGES 32
+
+
+struct DIRTY_Range{
+  long start,end;
+};
+
+static struct DIRTY_Range *ranges=NULL;	/* ranges[ch*DIRTY_MAXRANGES+i], sorted. */
+static int *num_ranges=NULL;
+static int num_channels=0;
+static bool all=true;
+
+
+void DIRTY_begin(void){
+  if(num_channels<samps_per_frame){
+    free(ranges);
+    free(num_ranges);
+    ranges=erroralloc(sizeof(struct DIRTY_Range)*DIRTY_MAXRANGES*samps_per_frame);
+    num_ranges=erroralloc(sizeof(int)*samps_per_frame);
+    num_channels=samps_per_frame;
+  }
+
+  all=true;
+}
+
+void DIRTY_add(int ch,long start,long end){
+  struct DIRTY_Range *r;
+  int num,i,j;
+
+  if(start<0)
+    start=0;
+  if(end>N)
+    end=N;
+  if(start>=end)
+    return;
+
+  if(all){
+    for(i=0;i<num_channels;i++)
+      num_ranges[i]=0;
+    all=false;
+  }
+
+  r=ranges+ch*DIRTY_MAXRANGES;
+  num=num_ranges[ch];
+
+  /* Join with the ranges it overlaps or touches. */
+  for(i=0;i<num && r[i].end<start;i++);
+  for(j=i;j<num && r[j].start<=end;j++){
+    start=mammut_min(start,r[j].start);
+    end=mammut_max(end,r[j].end);
+  }
+
+  if(j==i){
+    if(num==DIRTY_MAXRANGES){
+      /* Full. Join the two closest ranges first, and try again. */
+      int closest=0;
+      for(j=1;j<num-1;j++)
+	if(r[j+1].start-r[j].end < r[closest+1].start-r[closest].end)
+	  closest=j;
+      r[closest].end=r[closest+1].end;
+      memmove(&r[closest+1],&r[closest+2],sizeof(struct DIRTY_Range)*(num-closest-2));
+      num_ranges[ch]=num-1;
+      DIRTY_add(ch,start,end);
+      return;
+    }
+    memmove(&r[i+1],&r[i],sizeof(struct DIRTY_Range)*(num-i));
+    num++;
+  }else{
+    memmove(&r[i+1],&r[j],sizeof(struct DIRTY_Range)*(num-j));
+    num-=j-i-1;
+  }
+
+  r[i].start=start;
+  r[i].end=end;
+  num_ranges[ch]=num;
+}
+
+void DIRTY_end(void){
+  RC_spectrumChanged();
+  MP_spectrumChanged();
+  UNDO_spectrumChanged();
+}
+
+void DIRTY_all(void){
+  DIRTY_begin();
+  DIRTY_end();
+}
+
+
+/* True if the whole spectrum is dirty. It may also have changed size. */
+bool DIRTY_isAll(void){
+  return all || num_channels<samps_per_frame;
+}
+
+int DIRTY_getNumRanges(int ch){
+  if(DIRTY_isAll())
+    return 1;
+  return num_ranges[ch];
+}
+
+void DIRTY_getRange(int ch,int i,long *start,long *end){
+  if(DIRTY_isAll()){
+    *start=0;
+    *end=N;
+  }else{
+    *start=ranges[ch*DIRTY_MAXRANGES+i].start;
+    *end=ranges[ch*DIRTY_MAXRANGES+i].end;
+  }
+}
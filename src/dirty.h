@@ -0,0 +1,11 @@
+
+/* Which parts of the spectrum (lyd) a change has touched, so that the
+   caches of the spectrum only need to update those parts. */
+
+extern LANGSPEC void DIRTY_begin(void);
+extern LANGSPEC void DIRTY_add(int ch,long start,long end);
+extern LANGSPEC void DIRTY_end(void);
+extern LANGSPEC void DIRTY_all(void);
+extern LANGSPEC bool DIRTY_isAll(void);
+extern LANGSPEC int DIRTY_getNumRanges(int ch);
+extern LANGSPEC void DIRTY_getRange(int ch,int i,long *start,long *end);
@@ -1,6 +1,12 @@
 
 #include "mammut.h"
+#include "threadpool.h"
+#include "fftsimd.h"
+#include "spectrummem.h"
 
+#ifndef _WIN32
+#  include <pthread.h>
+#endif
 
 
 /* FFT ROUTINES */
@@ -10,162 +16,912 @@
    Fourier spectrum, with x[1] replaced with the real part of the Nyquist
    frequency value.  If forward is false, rfft expects x to contain a
    positive frequency spectrum arranged as before, and replaces it with
-   2*N real values.  N MUST be a power of 2. */
+   2*N real values.  2*N must be a length returned by fft_size(). */
 
 
-static void cfft(float x[], int NC, int forward);
+static void cfft(mammut_float x[], long NC, int forward, int *progval);
+static int cfft_steps(long NC);
 
-void rfft(float x[], int N, int forward)
+
+/* Loops over fewer floats than this are not split between threads. */
+#define FFT_MINPARALLEL 32768
+
+static void fft_run(void (*func)(void *arg,long start,long end),void *arg,long num,long size){
+  if(size<FFT_MINPARALLEL)
+    func(arg,0,num);
+  else
+    TP_run(func,arg,num);
+}
+
+
+
+/* TWIDDLE FACTORS */
+
+/* The twiddle factors are computed in double precision once and kept,
+   instead of using the trigonometric recurrence, which loses too much
+   precision for the giant transforms.
+
+   stagetw[h+k] = exp(2*pi*i*k/(2*h)), 0<=k<h, for the butterfly stages
+   with h <= STAGETW_MAX. Larger stages, and the real-spectrum pass, use
+   exp(2*pi*i*j/size) = coarse[j>>shift] * fine[j&mask], which needs
+   two tables of about sqrt(size) values each. */
+
+#define STAGETW_MAX 16384
+#define TWCHUNK 256
+
+static mammut_float *stagetw=NULL;
+
+static struct FFT_Kernels simd;
+
+static long tw_size=0;
+static int tw_shift;
+static long tw_mask;
+static double *tw_coarse=NULL;
+static double *tw_fine=NULL;
+
+/* The twiddle tables are for one size at a time, so a transform from
+   another thread (rfft_background) must not run at the same time as
+   one from the gui. */
+#ifndef _WIN32
+static pthread_mutex_t fft_lock=PTHREAD_MUTEX_INITIALIZER;
+#  define FFT_LOCK() pthread_mutex_lock(&fft_lock)
+#  define FFT_UNLOCK() pthread_mutex_unlock(&fft_lock)
+#else
+#  define FFT_LOCK()
+#  define FFT_UNLOCK()
+#endif
+
+
+static void twiddle_init(long size){
+  long i;
+  int lg;
+
+  if(stagetw==NULL){
+    long h;
+    FFTSIMD_init(&simd);
+    stagetw=erroralloc(sizeof(mammut_float)*4*STAGETW_MAX);
+    for(h=1;h<=STAGETW_MAX;h*=2)
+      for(i=0;i<h;i++){
+	stagetw[2*(h+i)]   = cos(M_PI*i/h);
+	stagetw[2*(h+i)+1] = sin(M_PI*i/h);
+      }
+  }
+
+  if(size==tw_size)
+    return;
+
+  free(tw_coarse);
+  free(tw_fine);
+
+  for(lg=0;(1L<<(2*lg))<size;lg++);
+  tw_shift=lg;
+  tw_mask=(1L<<lg)-1;
+
+  tw_coarse=erroralloc(sizeof(double)*2*((size>>lg)+1));
+  tw_fine=erroralloc(sizeof(double)*2*(1L<<lg));
+
+  for(i=0;i<=(size>>lg);i++){
+    tw_coarse[2*i]   = cos(2.*M_PI*(double)(i<<lg)/size);
+    tw_coarse[2*i+1] = sin(2.*M_PI*(double)(i<<lg)/size);
+  }
+  for(i=0;i<=tw_mask;i++){
+    tw_fine[2*i]   = cos(2.*M_PI*(double)i/size);
+    tw_fine[2*i+1] = sin(2.*M_PI*(double)i/size);
+  }
+
+  tw_size=size;
+}
+
+/* w[k] = exp(2*pi*i*(start+k)*stride/tw_size), 0<=k<num */
+static void twiddle_get(mammut_float *w, long start, long stride, int num){
+  int k;
+  long j=start*stride;
+
+  for(k=0;k<num;k++,j+=stride){
+    double *c=tw_coarse+2*(j>>tw_shift);
+    double *f=tw_fine+2*(j&tw_mask);
+    w[2*k]   = c[0]*f[0] - c[1]*f[1];
+    w[2*k+1] = c[0]*f[1] + c[1]*f[0];
+  }
+}
+
+
+
+/* REAL SPECTRUM PASS */
+
+struct RfftJob{
+  mammut_float *x;
+  long N;
+  int num;			/* Number of transforms, 2*N values apart. */
+  mammut_float c1,c2;
+  mammut_float sign;
+  mammut_float *xr,*xi;		/* One for each transform. */
+};
+
+/* The general iteration, for the complex values i..i+num-1 and N-i..N-i-num+1. */
+static void rfft_kernel(mammut_float *x, long N, long i, const mammut_float *w, int num, mammut_float c1, mammut_float c2, mammut_float sign)
 {
-  float 	c1,c2,
-  		h1r,h1i,
+  mammut_float 	h1r,h1i,
 		h2r,h2i,
-		wr,wi,
-		wpr,wpi,
-  		temp,
-		theta;
-  float 	xr,xi;
-  int 		i,
-		i1,i2,i3,i4,
+		wr,wi;
+  long 		i1,i2,i3,i4,
 		N2p1;
-  //  static int 	first = 1;
+  int		k;
+
+    if ( simd.real != NULL ) {
+	k = simd.real(x, N, i, w, num, c1, c2, sign);
+	i += k; w += 2*k; num -= k;
+    }
 
-    theta = PI/N;
-    wr = 1.;
-    wi = 0.;
-    c1 = 0.5;
-    if ( forward ) {
-	c2 = -0.5;
-	cfft( x, N, forward );
-	xr = x[0];
-	xi = x[1];
-    } else {
-	c2 = 0.5;
-	theta = -theta;
-	xr = x[1];
-	xi = 0.;
-	x[1] = 0.;
-    }
-    wpr = -2.*powf( sinf( 0.5*theta ), 2. );
-    wpi = sinf( theta );
     N2p1 = (N<<1) + 1;
-    for ( i = 0; i <= N>>1; i++ ) {
+    for ( k = 0; k < num; k++, i++ ) {
+	wr = w[2*k];
+	wi = sign*w[2*k+1];
 	i1 = i<<1;
 	i2 = i1 + 1;
 	i3 = N2p1 - i2;
 	i4 = i3 + 1;
-	if ( i == 0 ) {
-	    h1r =  c1*(x[i1] + xr );
-	    h1i =  c1*(x[i2] - xi );
-	    h2r = -c2*(x[i2] + xi );
-	    h2i =  c2*(x[i1] - xr );
-	    x[i1] =  h1r + wr*h2r - wi*h2i;
-	    x[i2] =  h1i + wr*h2i + wi*h2r;
-	    xr =  h1r - wr*h2r + wi*h2i;
-	    xi = -h1i + wr*h2i + wi*h2r;
-	} else {
-	    h1r =  c1*(x[i1] + x[i3] );
-	    h1i =  c1*(x[i2] - x[i4] );
-	    h2r = -c2*(x[i2] + x[i4] );
-	    h2i =  c2*(x[i1] - x[i3] );
-	    x[i1] =  h1r + wr*h2r - wi*h2i;
-	    x[i2] =  h1i + wr*h2i + wi*h2r;
-	    x[i3] =  h1r - wr*h2r + wi*h2i;
-	    x[i4] = -h1i + wr*h2i + wi*h2r;
+	h1r =  c1*(x[i1] + x[i3] );
+	h1i =  c1*(x[i2] - x[i4] );
+	h2r = -c2*(x[i2] + x[i4] );
+	h2i =  c2*(x[i1] - x[i3] );
+	x[i1] =  h1r + wr*h2r - wi*h2i;
+	x[i2] =  h1i + wr*h2i + wi*h2r;
+	x[i3] =  h1r - wr*h2r + wi*h2i;
+	x[i4] = -h1i + wr*h2i + wi*h2r;
+    }
+}
+
+/* The twiddles of a chunk are computed once, and used for all the transforms. */
+static void rfft_chunk(void *arg,long start,long end)
+{
+  struct RfftJob *job=arg;
+  mammut_float 	*x,
+		c1=job->c1,
+		c2=job->c2,
+  		h1r,h1i,
+		h2r,h2i,
+		wr,wi;
+  mammut_float		w[2*TWCHUNK];
+  long 		i;
+  int		num,t;
+
+    for ( i = start; i < end; i += num ) {
+	num = mammut_min(TWCHUNK, end-i);
+	twiddle_get(w, i, 1, num);
+	for ( t = 0; t < job->num; t++ ) {
+	    x = job->x + 2*job->N*t;
+	    if ( i == 0 ) {
+		wr = w[0];
+		wi = job->sign*w[1];
+		h1r =  c1*(x[0] + job->xr[t] );
+		h1i =  c1*(x[1] - job->xi[t] );
+		h2r = -c2*(x[1] + job->xi[t] );
+		h2i =  c2*(x[0] - job->xr[t] );
+		x[0] =  h1r + wr*h2r - wi*h2i;
+		x[1] =  h1i + wr*h2i + wi*h2r;
+		job->xr[t] =  h1r - wr*h2r + wi*h2i;
+		job->xi[t] = -h1i + wr*h2i + wi*h2r;
+		rfft_kernel(x, job->N, 1, w+2, num-1, c1, c2, job->sign);
+	    } else
+		rfft_kernel(x, job->N, i, w, num, c1, c2, job->sign);
 	}
-	wr = (temp = wr)*wpr - wi*wpi + wr;
-	wi = wi*wpr + temp*wpi + wi;
     }
-    if ( forward )
-	x[1] = xr;
-    else
-	cfft( x, N, forward );
 }
 
-/* cfft replaces float array x containing NC complex values
-   (2*NC float values alternating real, imagininary, etc.)
-   by its Fourier transform if forward is true, or by its
-   inverse Fourier transform if forward is false, using a
-   recursive Fast Fourier transform method due to Danielson
-   and Lanczos.  NC MUST be a power of 2. */
+/* num transforms, one after another, each using all the threads.
+   The real-spectrum pass is done for all of them at once. */
+static void rfft_serial(mammut_float x[], long N, int num, int forward, int *progval)
+{
+  struct RfftJob job;
+  int		t;
+
+    /* The scaling of the complex transform (1/2N forward, 2 inverse) is
+       done here, to save a pass over the data. */
+    job.x = x;
+    job.N = N;
+    job.num = num;
+    job.xr = erroralloc(sizeof(mammut_float)*2*num);
+    job.xi = job.xr + num;
+    if ( forward ) {
+	job.c1 = 0.5/(2.*N);
+	job.c2 = -0.5/(2.*N);
+	job.sign = 1.;
+	for ( t = 0; t < num; t++ ) {
+	    cfft( x + 2*N*t, N, forward, progval );
+	    job.xr[t] = x[2*N*t];
+	    job.xi[t] = x[2*N*t+1];
+	}
+    } else {
+	job.c1 = 0.5*2.;
+	job.c2 = 0.5*2.;
+	job.sign = -1.;
+	for ( t = 0; t < num; t++ ) {
+	    job.xr[t] = x[2*N*t+1];
+	    job.xi[t] = 0.;
+	    x[2*N*t+1] = 0.;
+	}
+    }
+
+    /* Iteration i works on the complex values i and N-i, so the iterations are independent. */
+    fft_run(rfft_chunk, &job, (N>>1)+1, 2L*N*num);
+
+    for ( t = 0; t < num; t++ ) {
+	if ( forward )
+	    x[2*N*t+1] = job.xr[t];
+	else
+	    cfft( x + 2*N*t, N, forward, progval );
+    }
+
+    free(job.xr);
+}
+
+struct RfftMultiJob{
+  mammut_float *x;
+  long N;
+  int forward;
+  int *progval;
+};
+
+static void rfft_multi_chunk(void *arg,long start,long end)
+{
+  struct RfftMultiJob *job=arg;
+  long		t;
+
+    for ( t = start; t < end; t++ ) {
+	rfft_serial(job->x + 2*job->N*t, job->N, 1, job->forward, NULL);
+	__sync_fetch_and_add(job->progval, cfft_steps(job->N));
+    }
+}
 
-static void cfft( x, NC, forward )
-float x[]; int NC, forward;
+static void rfft_multi_do(mammut_float x[], int N, int num, int forward, int *progval, bool showprogress)
 {
-  float 	wr,wi,
-		wpr,wpi,
-		theta,
-		scale;
-  int 		mmax,
-		ND,
-		m,
-		i,j,
-		delta;
-  int logND;
+  struct RfftMultiJob job;
+  int		threads = TP_getNumThreads();
+  int		par = 0;
+
+    FFT_LOCK();
+
+    twiddle_init(2L*N);
+
+    if ( num >= threads && !SM_isOnDisk(x) )
+	par = num - num%threads;
+
+    if ( showprogress )
+	GUI_startprogressbar(0,progval,num*cfft_steps(N));
+
+    if ( par > 0 ) {
+	job.x = x;
+	job.N = N;
+	job.forward = forward;
+	job.progval = progval;
+	TP_run(rfft_multi_chunk, &job, par);
+    }
+
+    if ( par < num )
+	rfft_serial(x + 2L*N*par, N, num-par, forward, progval);
 
+    if ( showprogress )
+	GUI_stopprogressbar();
 
+    FFT_UNLOCK();
+}
+
+/* Transforms num arrays of 2*N values, placed one after another, like
+   the channels of lyd. When there are at least as many transforms as
+   threads, each thread does whole transforms, which needs no
+   synchronization between the passes. The rest (and spectra on disk,
+   where the threads would compete for the disk) are done one at a time
+   with all the threads. */
+void rfft_multi(mammut_float x[], int N, int num, int forward)
+{
   int_progval();
+  rfft_multi_do(x, N, num, forward, progval, true);
+}
+
+/* Like rfft_multi, but without the progressbar, so it can be called from
+   another thread than the gui. Waits for any other transform to finish. */
+void rfft_background(mammut_float x[], int N, int num, int forward)
+{
+  int		progval = 0;
+  rfft_multi_do(x, N, num, forward, &progval, false);
+}
+
+void rfft(mammut_float x[], int N, int forward)
+{
+    rfft_multi(x, N, 1, forward);
+}
+
+
+
+/* COMPLEX TRANSFORM */
+
+/* Two stages (h and 2h) at a time on x[0], x[h], x[2h], x[3h], k=0..num-1.
+   w1=exp(2*pi*i*k/2h) and w2=exp(2*pi*i*k/4h), conjugated for the inverse transform. */
+static void radix4_kernel(mammut_float *x, long h, const mammut_float *w1, const mammut_float *w2, int num, mammut_float sign)
+{
+  mammut_float *x0=x, *x1=x+2*h, *x2=x+4*h, *x3=x+6*h;
+  int k=0;
+
+    if ( simd.radix4 != NULL )
+	k = simd.radix4(x, h, w1, w2, num, sign);
+
+    for ( ; k < num; k++ ) {
+	mammut_float w1r = w1[2*k], w1i = sign*w1[2*k+1];
+	mammut_float w2r = w2[2*k], w2i = sign*w2[2*k+1];
+	mammut_float a0r = x0[2*k], a0i = x0[2*k+1];
+	mammut_float a2r = x2[2*k], a2i = x2[2*k+1];
+	mammut_float tr,ti,b0r,b0i,b1r,b1i,b2r,b2i,b3r,b3i;
+
+	/* stage h */
+	tr = w1r*x1[2*k] - w1i*x1[2*k+1];
+	ti = w1r*x1[2*k+1] + w1i*x1[2*k];
+	b0r = a0r + tr; b0i = a0i + ti;
+	b1r = a0r - tr; b1i = a0i - ti;
+
+	tr = w1r*x3[2*k] - w1i*x3[2*k+1];
+	ti = w1r*x3[2*k+1] + w1i*x3[2*k];
+	b2r = a2r + tr; b2i = a2i + ti;
+	b3r = a2r - tr; b3i = a2i - ti;
+
+	/* stage 2h. The twiddle for b1/b3 is w2*(sign*i). */
+	tr = w2r*b2r - w2i*b2i;
+	ti = w2r*b2i + w2i*b2r;
+	x0[2*k] = b0r + tr; x0[2*k+1] = b0i + ti;
+	x2[2*k] = b0r - tr; x2[2*k+1] = b0i - ti;
+
+	tr = -sign*(w2r*b3i + w2i*b3r);
+	ti = sign*(w2r*b3r - w2i*b3i);
+	x1[2*k] = b1r + tr; x1[2*k+1] = b1i + ti;
+	x3[2*k] = b1r - tr; x3[2*k+1] = b1i - ti;
+    }
+}
+
+/* One radix-2 stage on x[0] and x[h], k=0..num-1, with w=exp(2*pi*i*k/2h). */
+static void radix2_kernel(mammut_float *x, long h, const mammut_float *w, int num, mammut_float sign)
+{
+  mammut_float *x0=x, *x1=x+2*h;
+  int k=0;
+
+    if ( simd.radix2 != NULL )
+	k = simd.radix2(x, h, w, num, sign);
+
+    for ( ; k < num; k++ ) {
+	mammut_float wr = w[2*k], wi = sign*w[2*k+1];
+	mammut_float tr = wr*x1[2*k] - wi*x1[2*k+1];
+	mammut_float ti = wr*x1[2*k+1] + wi*x1[2*k];
+	x1[2*k] = x0[2*k] - tr; x1[2*k+1] = x0[2*k+1] - ti;
+	x0[2*k] += tr; x0[2*k+1] += ti;
+    }
+}
+
+/* All the stages of a bitreversed array of n<=2*STAGETW_MAX complex values. */
+static void cfft_stages(mammut_float *x, long n, mammut_float sign)
+{
+  long h=1, g;
+  int lg;
+
+    for ( lg = 0; (1L<<lg) < n; lg++ );
+
+    if ( lg & 1 ) {
+	for ( g = 0; g < n; g += 2 ) {
+	    mammut_float rtemp = x[2*g+2], itemp = x[2*g+3];
+	    x[2*g+2] = x[2*g] - rtemp;
+	    x[2*g+3] = x[2*g+1] - itemp;
+	    x[2*g] += rtemp;
+	    x[2*g+1] += itemp;
+	}
+	h = 2;
+    }
+
+    for ( ; h < n; h *= 4 )
+	for ( g = 0; g < n; g += 4*h )
+	    radix4_kernel(x + 2*g, h, stagetw + 2*h, stagetw + 4*h, h, sign);
+}
+
+
+/* The giant transforms are done in two phases, so that most of the work
+   is done on data which is in the cache:
+
+   1. The array is seen as R rows of FFT_BLOCK complex values. After the
+      bitreversal, the first log2(FFT_BLOCK) stages only combine values
+      inside a row, so each row is transformed on its own.
+
+   2. The remaining log2(R) stages combine values in the same column.
+      A tile of columns is copied into a buffer, all the remaining
+      stages are done there, and the tile is copied back.
+
+   The rows and the tiles are split between the worker threads.
 
+   When the spectrum is memory-mapped from disk (spectrummem.c), the tiles
+   are made wider, so that every row of a tile is at least a page (512
+   complex values), as long as the tile is not bigger than FFT_DISKTILE. */
 
-    ND = NC<<1;
-    logND=log(ND);
-
-    GUI_startprogressbar(0,progval,log(ND*2)*100);
-    //GUI_startprogressbar(2,&progval,ND);
-
-    bitreverse( x, ND );
-
-    printf("About top do something\n");
-    for ( mmax = 2; mmax < ND; mmax = delta ) {
-      //        XtVaSetValues(progressScale, XmNvalue, 100*mmax/ND, NULL);
-      *progval=log(mmax*2)*100;
-      //progval=mmax;
-
-      //printf("About top do something %d / %d / %d\n",0,progval,ND);
-      //printf("About top do something %d / %d / %d\n",0,progval,(int)log(ND*2)*100);
-      //GUI_progressbar(0,log(mmax*2),logND);
-
-	delta = mmax<<1;
-	theta = TWOPI/( forward? mmax : -mmax );
-	wpr = -2.*powf( sinf( 0.5*theta ), 2. );
-	wpi = sinf( theta );
-	wr = 1.;
-	wi = 0.;
-	for ( m = 0; m < mmax; m += 2 ) {
-	  register float rtemp, itemp;
-	  for ( i = m; i < ND; i += delta ) {
-	    j = i + mmax;
-	    rtemp = wr*x[j] - wi*x[j+1];
-	    itemp = wr*x[j+1] + wi*x[j];
-	    x[j] = x[i] - rtemp;
-	    x[j+1] = x[i+1] - itemp;
-	    x[i] += rtemp;
-	    x[i+1] += itemp;
-	  }
-	  wr = (rtemp = wr)*wpr - wi*wpi + wr;
-	  wi = wi*wpr + rtemp*wpi + wi;
+#define FFT_BLOCK 16384
+#define FFT_TILE 65536
+#define FFT_DISKTILE (1<<23)
+
+struct CfftJob{
+  mammut_float *x;
+  long NC;
+  long R;
+  long T;
+  mammut_float sign;
+};
+
+static void block_chunk(void *arg,long start,long end)
+{
+  struct CfftJob *job=arg;
+  long r;
+
+    for ( r = start; r < end; r++ )
+	cfft_stages(job->x + 2*r*FFT_BLOCK, FFT_BLOCK, job->sign);
+}
+
+static void column_chunk(void *arg,long start,long end)
+{
+  struct CfftJob *job=arg;
+  long R=job->R, T=job->T;
+  mammut_float *buf=erroralloc(sizeof(mammut_float)*2*(R+2)*T);
+  mammut_float *w1=buf+2*R*T, *w2=w1+2*T;
+  long tile,r,q,j,g;
+  int lgR;
+
+    for ( lgR = 0; (1L<<lgR) < R; lgR++ );
+
+    for ( tile = start; tile < end; tile++ ) {
+	long c0 = tile*T;
+
+	for ( r = 0; r < R; r++ )
+	    memcpy(buf + 2*r*T, job->x + 2*(r*FFT_BLOCK + c0), sizeof(mammut_float)*2*T);
+
+	/* Stage q combines row r with row r+q. The twiddle is exp(2*pi*i*((r%2q)*BLOCK+c)/(2q*BLOCK)). */
+	q = 1;
+	if ( lgR & 1 ) {
+	    twiddle_get(w1, c0, tw_size/(2*FFT_BLOCK), T);
+	    for ( g = 0; g < R; g += 2 )
+		radix2_kernel(buf + 2*g*T, T, w1, T, job->sign);
+	    q = 2;
+	}
+
+	for ( ; q < R; q *= 4 ) {
+	    for ( j = 0; j < q; j++ ) {
+		twiddle_get(w1, j*FFT_BLOCK + c0, tw_size/(2*q*FFT_BLOCK), T);
+		twiddle_get(w2, j*FFT_BLOCK + c0, tw_size/(4*q*FFT_BLOCK), T);
+		for ( g = j; g < R; g += 4*q )
+		    radix4_kernel(buf + 2*g*T, q*T, w1, w2, T, job->sign);
+	    }
+	}
+
+	for ( r = 0; r < R; r++ )
+	    memcpy(job->x + 2*(r*FFT_BLOCK + c0), buf + 2*r*T, sizeof(mammut_float)*2*T);
+    }
+
+    free(buf);
+}
+
+/* The power-of-two transform. Advances progval (may be NULL) by 2. */
+static void cfft_pow2(mammut_float x[], long NC, mammut_float sign, int *progval)
+{
+  struct CfftJob job;
+
+    job.x = x;
+    job.NC = NC;
+    job.sign = sign;
+
+    bitreverse( x, NC<<1 );
+
+    if ( progval != NULL )
+	(*progval)++;
+
+    if ( NC <= FFT_BLOCK ) {
+	cfft_stages(x, NC, job.sign);
+    } else {
+	job.R = NC/FFT_BLOCK;
+	job.T = FFT_TILE/job.R;
+	if ( SM_isOnDisk(x) )
+	    job.T = M_MAX(job.T, mammut_min(512, FFT_DISKTILE/job.R));
+	job.T = mammut_min(FFT_BLOCK, M_MAX(8, job.T));
+	TP_run(block_chunk, &job, job.R);
+	TP_run(column_chunk, &job, FFT_BLOCK/job.T);
+    }
+
+    if ( progval != NULL )
+	(*progval)++;
+}
+
+
+
+/* MIXED RADIX
+
+   Transforms of NC = m * P values, where P is a power of two and m a
+   product of 3s and 5s, are done by decimation in frequency:
+
+   1. A radix-r pass (r is 3 or 5) on a block of L values does the
+      r-point transforms of x[n], x[n+L/r], ..., 0<=n<L/r, and multiplies
+      them by the twiddles, so that block j of L/r values afterwards
+      transforms into the values r*k+j of the transform of the block.
+      After one pass for each factor of m, there are m blocks of P values.
+   2. Each block is transformed by the power-of-two code above.
+   3. The value k of block D belongs at m*k+K(D), where K(D) is D with
+      its digits reversed. The values are moved there in two steps, both
+      working on runs of PERMUTE_RUN values, so that it is not much slower
+      than the bitreversal: whole runs are moved to their final row, and
+      then each row of m runs is transposed.
+
+   The sizes allowed are chosen by fft_size(). */
+
+#define PERMUTE_RUN 512
+#define FFT_MAXODD 3
+#define FFT_MINPOW2 2048
+
+struct OddJob{
+  mammut_float *x;
+  long NC;
+  long L;
+  int r;
+  mammut_float sign;
+};
+
+static void odd_chunk(void *arg,long start,long end)
+{
+  struct OddJob *job=arg;
+  long		S=job->L/job->r,
+		stride=2*job->NC/job->L,
+		i,n1;
+  mammut_float		sign=job->sign;
+  mammut_float		w[4][2*TWCHUNK];
+  mammut_float		*x0,*x1,*x2,*x3,*x4,*wp;
+  int		k,k2,num;
+
+  const mammut_float	S3 = sin(2.*M_PI/3.),
+		C51 = cos(2.*M_PI/5.), S51 = sin(2.*M_PI/5.),
+		C52 = cos(4.*M_PI/5.), S52 = sin(4.*M_PI/5.);
+
+    for ( i = start; i < end; i += num ) {
+	n1 = i%S;
+	num = mammut_min(mammut_min(TWCHUNK, end-i), S-n1);
+	x0 = job->x + 2*((i/S)*job->L + n1);
+	x1 = x0 + 2*S;
+	x2 = x1 + 2*S;
+	x3 = x2 + 2*S;
+	x4 = x3 + 2*S;
+
+	for ( k2 = 1; k2 < job->r; k2++ )
+	    twiddle_get(w[k2-1], n1, k2*stride, num);
+
+	if ( job->r == 3 ) {
+	    for ( k = 0; k < num; k++ ) {
+		mammut_float t1r = x1[2*k] + x2[2*k], t1i = x1[2*k+1] + x2[2*k+1];
+		mammut_float t2r = x0[2*k] - 0.5*t1r, t2i = x0[2*k+1] - 0.5*t1i;
+		mammut_float t3r = sign*S3*(x1[2*k] - x2[2*k]), t3i = sign*S3*(x1[2*k+1] - x2[2*k+1]);
+		mammut_float yr[3],yi[3];
+
+		yr[1] = t2r - t3i; yi[1] = t2i + t3r;
+		yr[2] = t2r + t3i; yi[2] = t2i - t3r;
+		x0[2*k] += t1r; x0[2*k+1] += t1i;
+
+		for ( k2 = 1; k2 < 3; k2++ ) {
+		    mammut_float *xp = x0 + 2*k2*S;
+		    wp = w[k2-1] + 2*k;
+		    xp[2*k] = wp[0]*yr[k2] - sign*wp[1]*yi[k2];
+		    xp[2*k+1] = wp[0]*yi[k2] + sign*wp[1]*yr[k2];
+		}
+	    }
+	} else {
+	    for ( k = 0; k < num; k++ ) {
+		mammut_float t1r = x1[2*k] + x4[2*k], t1i = x1[2*k+1] + x4[2*k+1];
+		mammut_float t2r = x2[2*k] + x3[2*k], t2i = x2[2*k+1] + x3[2*k+1];
+		mammut_float t3r = x1[2*k] - x4[2*k], t3i = x1[2*k+1] - x4[2*k+1];
+		mammut_float t4r = x2[2*k] - x3[2*k], t4i = x2[2*k+1] - x3[2*k+1];
+		mammut_float a1r = x0[2*k] + C51*t1r + C52*t2r, a1i = x0[2*k+1] + C51*t1i + C52*t2i;
+		mammut_float a2r = x0[2*k] + C52*t1r + C51*t2r, a2i = x0[2*k+1] + C52*t1i + C51*t2i;
+		mammut_float b1r = sign*(S51*t3r + S52*t4r), b1i = sign*(S51*t3i + S52*t4i);
+		mammut_float b2r = sign*(S52*t3r - S51*t4r), b2i = sign*(S52*t3i - S51*t4i);
+		mammut_float yr[5],yi[5];
+
+		yr[1] = a1r - b1i; yi[1] = a1i + b1r;
+		yr[4] = a1r + b1i; yi[4] = a1i - b1r;
+		yr[2] = a2r - b2i; yi[2] = a2i + b2r;
+		yr[3] = a2r + b2i; yi[3] = a2i - b2r;
+		x0[2*k] += t1r + t2r; x0[2*k+1] += t1i + t2i;
+
+		for ( k2 = 1; k2 < 5; k2++ ) {
+		    mammut_float *xp = x0 + 2*k2*S;
+		    wp = w[k2-1] + 2*k;
+		    xp[2*k] = wp[0]*yr[k2] - sign*wp[1]*yi[k2];
+		    xp[2*k+1] = wp[0]*yi[k2] + sign*wp[1]*yr[k2];
+		}
+	    }
+	}
+    }
+}
+
+struct PermuteJob{
+  mammut_float *x;
+  long m;
+  long B;
+};
+
+/* Transposes rows of m runs of B values to B runs of m values. */
+static void permute_chunk(void *arg,long start,long end)
+{
+  struct PermuteJob *job=arg;
+  long m=job->m, B=job->B;
+  mammut_float *buf=erroralloc(sizeof(mammut_float)*2*m*B);
+  long q,K,b;
+
+    for ( q = start; q < end; q++ ) {
+	mammut_float *x = job->x + 2*q*m*B;
+	memcpy(buf, x, sizeof(mammut_float)*2*m*B);
+	for ( K = 0; K < m; K++ )
+	    for ( b = 0; b < B; b++ ) {
+		x[2*(b*m+K)] = buf[2*(K*B+b)];
+		x[2*(b*m+K)+1] = buf[2*(K*B+b)+1];
+	    }
+    }
+
+    free(buf);
+}
+
+static void cfft_permute(mammut_float x[], long NC, long m, const int *radices, int numradices)
+{
+  struct PermuteJob job;
+  long		P=NC/m,
+		B=mammut_min(P, PERMUTE_RUN),
+		Q=P/B,
+		numruns=m*Q,
+		run,cur,nxt;
+  int		*K=erroralloc(sizeof(int)*m);
+  unsigned char	*done=erroralloc((numruns+7)/8);
+  mammut_float		*buf=erroralloc(sizeof(mammut_float)*4*B),
+		*bufa=buf,
+		*bufb=buf+2*B,
+		*temp;
+  long		D;
+  int		n;
+
+    /* K(D): block D = digits (j1,j2,...) of the passes, most significant first,
+       holds the values m*k + j1 + r1*j2 + r1*r2*j3 + ... */
+    for ( D = 0; D < m; D++ ) {
+	long rest = D, weight = 1, div = m;
+	K[D] = 0;
+	for ( n = 0; n < numradices; n++ ) {
+	    div /= radices[n];
+	    K[D] += weight*(rest/div);
+	    rest %= div;
+	    weight *= radices[n];
+	}
+    }
+
+    /* Run q of block D goes to run K(D) of row q. */
+#define PERMUTE_DEST(run) (((run)%Q)*m + K[(run)/Q])
+    for ( run = 0; run < numruns; run++ ) {
+	if ( done[run>>3] & (1<<(run&7)) )
+	    continue;
+	done[run>>3] |= 1<<(run&7);
+	if ( PERMUTE_DEST(run) == run )
+	    continue;
+	memcpy(bufa, x + 2*run*B, sizeof(mammut_float)*2*B);
+	for ( cur = run; ; cur = nxt ) {
+	    nxt = PERMUTE_DEST(cur);
+	    if ( nxt == run ) {
+		memcpy(x + 2*nxt*B, bufa, sizeof(mammut_float)*2*B);
+		break;
+	    }
+	    memcpy(bufb, x + 2*nxt*B, sizeof(mammut_float)*2*B);
+	    memcpy(x + 2*nxt*B, bufa, sizeof(mammut_float)*2*B);
+	    done[nxt>>3] |= 1<<(nxt&7);
+	    temp = bufa; bufa = bufb; bufb = temp;
+	}
+    }
+#undef PERMUTE_DEST
+
+    job.x = x;
+    job.m = m;
+    job.B = B;
+    fft_run(permute_chunk, &job, Q, 2*NC);
+
+    free(buf);
+    free(done);
+    free(K);
+}
+
+/* Returns the smallest real fft length >= n which rfft can do. That is,
+   2^a*3^b*5^c, with b+c <= FFT_MAXODD. The odd factors are only used for
+   lengths above 2*FFT_MINPOW2. */
+long fft_size(long n)
+{
+  long best=1, m, m3, P;
+  int b, c;
+
+    while ( best < n )
+	best *= 2;
+
+    for ( b = 0, m3 = 1; b <= FFT_MAXODD; b++, m3 *= 3 )
+	for ( c = 0, m = m3; b+c <= FFT_MAXODD; c++, m *= 5 ) {
+	    if ( m == 1 )
+		continue;
+	    for ( P = 2*FFT_MINPOW2; P*m < n; P *= 2 );
+	    if ( P*m < best )
+		best = P*m;
 	}
+
+    return best;
+}
+
+
+/* cfft replaces array x containing NC complex values
+   (2*NC values alternating real, imagininary, etc.)
+   by its unscaled Fourier transform if forward is true, or by its
+   inverse Fourier transform if forward is false, using a
+   Fast Fourier transform method due to Danielson and Lanczos.
+   The stages are done two at a time (radix 4), and large
+   transforms are blocked as described above. NC must be
+   2^a*3^b*5^c, and twiddle_init(2*NC) must have been called.
+   progval (may be NULL) is advanced by cfft_steps(NC). */
+
+static void cfft(mammut_float x[], long NC, int forward, int *progval)
+{
+  mammut_float		sign = forward ? 1. : -1.;
+  int		radices[64];
+  int		numradices = 0, n;
+  long		m = 1, L, P = NC;
+
+    while ( P%5 == 0 ) { radices[numradices++] = 5; P /= 5; m *= 5; }
+    while ( P%3 == 0 ) { radices[numradices++] = 3; P /= 3; m *= 3; }
+
+    if ( m == 1 ) {
+	cfft_pow2(x, NC, sign, progval);
+	if ( progval != NULL )
+	    (*progval)++;
+	return;
+    }
+
+    L = NC;
+    for ( n = 0; n < numradices; n++ ) {
+	struct OddJob job;
+	job.x = x;
+	job.NC = NC;
+	job.L = L;
+	job.r = radices[n];
+	job.sign = sign;
+	fft_run(odd_chunk, &job, NC/job.r, 2*NC);
+	L /= job.r;
+	if ( progval != NULL )
+	    (*progval)++;
+    }
+
+    for ( L = 0; L < m; L++ ) {
+	cfft_pow2(x + 2*L*P, P, sign, NULL);
+	if ( progval != NULL )
+	    (*progval)++;
+    }
+
+    cfft_permute(x, NC, m, radices, numradices);
+
+    if ( progval != NULL )
+	(*progval)++;
+}
+
+/* 3 for powers of two, one per odd pass, block and the permutation otherwise. */
+static int cfft_steps(long NC)
+{
+  int		numradices = 0;
+  long		m = 1;
+
+    while ( NC%5 == 0 ) { numradices++; NC /= 5; m *= 5; }
+    while ( NC%3 == 0 ) { numradices++; NC /= 3; m *= 3; }
+
+    return m == 1 ? 3 : numradices+m+1;
+}
+
+
+/* The bitreversal is done on tiles, so that it does not miss the cache
+   for every value. The index of a complex value is split into
+   [a (abits bits) | b | c (abits bits)], and the bitreversed index
+   is [rev(c) | rev(b) | rev(a)]. So all the values with the same b
+   (2^abits short rows) are moved to the values with b'=rev(b), and
+   can be copied in and out through a small buffer.
+
+   For spectra memory-mapped from disk, the short rows are made a page
+   long (BR_DISKBITS), so that every page is read and written once. */
+
+#define BR_BITS 5
+#define BR_DISKBITS 9
+
+struct BitreverseJob{
+  mammut_float *x;
+  long N;
+  int abits;
+  int bbits;
+};
+
+static int bitreverse_bits(long i, int bits){
+  int ret=0;
+  int n;
+  for(n=0;n<bits;n++)
+    if(i & (1L<<n))
+      ret |= 1<<(bits-1-n);
+  return ret;
+}
+
+static void bitreverse_tile_load(mammut_float *buf, mammut_float *x, long b, int abits, int bbits){
+  long size=1L<<abits;
+  long a;
+  for(a=0;a<size;a++)
+    memcpy(buf + 2*a*size, x + 2*( (a<<(bbits+abits)) | (b<<abits) ), sizeof(mammut_float)*2*size);
+}
+
+static void bitreverse_tile_store(mammut_float *x, mammut_float *buf, long b, int abits, int bbits, const int *rev){
+  long size=1L<<abits;
+  long a,c;
+  for(a=0;a<size;a++){
+    mammut_float *dst = x + 2*( (a<<(bbits+abits)) | (b<<abits) );
+    for(c=0;c<size;c++){
+      mammut_float *src = buf + 2*(rev[c]*size + rev[a]);
+      dst[2*c] = src[0];
+      dst[2*c+1] = src[1];
     }
+  }
+}
 
-/* scale output */
+static void bitreverse_chunk(void *arg,long start,long end)
+{
+  struct BitreverseJob *job=arg;
+  int abits=job->abits, bbits=job->bbits;
+  long size=1L<<abits;
+  mammut_float *bufa=erroralloc(sizeof(mammut_float)*4*size*size);
+  mammut_float *bufb=bufa+2*size*size;
+  int *rev=erroralloc(sizeof(int)*size);
+  long b,b2;
+  int i;
+
+    for ( i = 0; i < size; i++ )
+	rev[i] = bitreverse_bits(i, abits);
 
-    scale = forward ? 1./ND : 2.;
-    { register float *xi=x, *xe=x+ND;
-	while ( xi < xe )
-	    *xi++ *= scale;
+    for ( b = start; b < end; b++ ) {
+	b2 = bitreverse_bits(b, bbits);
+	if ( b2 < b )
+	    continue;
+	bitreverse_tile_load(bufa, job->x, b, abits, bbits);
+	if ( b2 == b ) {
+	    bitreverse_tile_store(job->x, bufa, b, abits, bbits, rev);
+	} else {
+	    bitreverse_tile_load(bufb, job->x, b2, abits, bbits);
+	    bitreverse_tile_store(job->x, bufa, b2, abits, bbits, rev);
+	    bitreverse_tile_store(job->x, bufb, b, abits, bbits, rev);
+	}
     }
 
-    GUI_stopprogressbar();
+    free(rev);
+    free(bufa);
 }
 
-/* bitreverse places float array x containing N/2 complex values
+/* bitreverse places array x containing N/2 complex values
    into bit-reversed order */
 
-void bitreverse(float x[], int N)
+void bitreverse(mammut_float x[], int N)
 {
-  float 	rtemp,itemp;
+  mammut_float 	rtemp,itemp;
   int 		i,j,
 		m;
+  int		abits=BR_BITS;
+
+    if ( N/2 >= 4L<<(2*BR_DISKBITS) && SM_isOnDisk(x) )
+	abits = BR_DISKBITS;
+
+    if ( N/2 >= 4L<<(2*abits) ) {
+	struct BitreverseJob job;
+	int lg;
+	for ( lg = 0; (1L<<lg) < N/2; lg++ );
+	job.x = x;
+	job.N = N;
+	job.abits = abits;
+	job.bbits = lg - 2*abits;
+	fft_run(bitreverse_chunk, &job, 1L<<job.bbits, N);
+	return;
+    }
 
     for ( i = j = 0; i < N; i += 2, j += m ) {
 	if ( j > i ) {
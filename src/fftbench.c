@@ -0,0 +1,161 @@
+
+/*
+  Benchmark and accuracy test for rfft().
+
+  Usage: fftbench [-o file] [minlog [maxlog]]
+
+  Transforms 2^minlog to 2^maxlog real values forward and back (default
+  2^12 to 2^28, or only 2^minlog if maxlog is not given). Prints the
+  time per value, an estimate of the GFLOPS (2.5*N*log2(N) flops per
+  transform, the usual count for a real fft) and the largest round-trip
+  error. The results are also written as comma separated values to the
+  file (default fftbench.csv).
+
+  The same environment variables as mammut are used, so engines can be
+  compared with for instance MAMMUT_SIMD=none, MAMMUT_THREADS=1 or
+  MAMMUT_MAXRAM=0. Build with "make -f Makefile.linux fftbench".
+*/
+
+#include "mammut.h"
+
+#include <stdarg.h>
+#include <time.h>
+
+#include "fftsimd.h"
+#include "spectrummem.h"
+#include "threadpool.h"
+
+
+/* Minimum time to spend on each size. Small sizes are repeated until it is reached. */
+#define BENCH_MINTIME 0.5
+
+
+/* fft.c and spectrummem.c are normally linked with the gui. */
+
+bool prefs_spectrumondisk=false;
+
+void GUI_aboveprogressbar(int curr,int maxvalue){}
+void GUI_startprogressbar(int minvalue,int *valtocheck,int maxvalue){}
+void GUI_stopprogressbar(void){}
+
+void printerror(const char *fmt, ...){
+  va_list argp;
+  va_start(argp,fmt);
+  vfprintf(stderr,fmt,argp);
+  va_end(argp);
+  fprintf(stderr,"\n");
+}
+
+void *erroralloc(size_t size){
+  void *ret=calloc(1,size);
+  if(ret==NULL){
+    fprintf(stderr,"fftbench: Could not allocate %ld bytes.\n",(long)size);
+    exit(1);
+  }
+  return ret;
+}
+
+
+static double bench_time(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/* The same sequence of numbers in [-1,1) every time it is started with the same seed. */
+static unsigned int bench_seed;
+
+static mammut_float bench_random(void){
+  bench_seed=bench_seed*1664525+1013904223;
+  return (mammut_float)((int)bench_seed/2147483648.);
+}
+
+
+int main(int argc,char **argv){
+  char *filename="fftbench.csv";
+  int minlog=12, maxlog=28;
+  int lg, numargs=0, i;
+  struct FFT_Kernels kernels;
+  FILE *file;
+
+  for(i=1;i<argc;i++){
+    if(!strcmp(argv[i],"-o") && i+1<argc)
+      filename=argv[++i];
+    else if(numargs==0){
+      minlog=maxlog=atoi(argv[i]);
+      numargs++;
+    }else
+      maxlog=atoi(argv[i]);
+  }
+
+  if(minlog<2 || maxlog>31 || minlog>maxlog){
+    fprintf(stderr,"Usage: fftbench [-o file] [minlog [maxlog]]\n");
+    return 1;
+  }
+
+  file=fopen(filename,"w");
+  if(file==NULL){
+    fprintf(stderr,"fftbench: Could not open %s.\n",filename);
+    return 1;
+  }
+
+  FFTSIMD_init(&kernels);
+
+  printf("engine: %s, threads: %d, precision: %s\n",
+	 kernels.name,TP_getNumThreads(),sizeof(mammut_float)==sizeof(double)?"double":"float");
+  printf("%10s %8s %9s %9s %9s %9s %10s\n","size","runs","fwd ns/pt","inv ns/pt","fwd GFLOP","inv GFLOP","roundtrip");
+
+  fprintf(file,"engine,threads,precision,size,runs,forward_ns_per_point,inverse_ns_per_point,forward_gflops,inverse_gflops,roundtrip_error\n");
+
+  for(lg=minlog;lg<=maxlog;lg++){
+    long N=1L<<lg;
+    long n;
+    mammut_float *x=SM_alloc(N);
+    double fwd=1e100, inv=1e100, total=0., error=0.;
+    double flops=2.5*N*lg;
+    int runs=0;
+
+    bench_seed=lg;
+    for(n=0;n<N;n++)
+      x[n]=bench_random();
+
+    do{
+      double t1=bench_time(),t2,t3;
+      rfft(x,N/2,FORWARD);
+      t2=bench_time();
+      rfft(x,N/2,INVERSE);
+      t3=bench_time();
+
+      fwd=mammut_min(fwd,t2-t1);
+      inv=mammut_min(inv,t3-t2);
+      total+=t3-t1;
+
+      if(runs==0){
+	bench_seed=lg;
+	for(n=0;n<N;n++){
+	  double diff=fabs(x[n]-bench_random());
+	  if(diff>error)
+	    error=diff;
+	}
+      }
+
+      runs++;
+    }while(total<BENCH_MINTIME);
+
+    printf("%10ld %8d %9.3f %9.3f %9.3f %9.3f %10.2e%s\n",
+	   N,runs,fwd*1e9/N,inv*1e9/N,flops/fwd*1e-9,flops/inv*1e-9,error,
+	   SM_isOnDisk(x)?" (on disk)":"");
+    fflush(stdout);
+
+    fprintf(file,"%s,%d,%s,%ld,%d,%g,%g,%g,%g,%g\n",
+	    kernels.name,TP_getNumThreads(),sizeof(mammut_float)==sizeof(double)?"double":"float",
+	    N,runs,fwd*1e9/N,inv*1e9/N,flops/fwd*1e-9,flops/inv*1e-9,error);
+    fflush(file);
+
+    SM_free(x);
+  }
+
+  fclose(file);
+
+  return 0;
+}
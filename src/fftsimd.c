@@ -0,0 +1,491 @@
+
+#include "mammut.h"
+
+#include "fftsimd.h"
+
+
+/*
+  SSE2 and AVX2 versions of the fft kernels. The values are interleaved
+  re/im floats, so an SSE register holds two complex values, and an AVX
+  register four. When compiled with MAMMUT_DOUBLE, the values are doubles,
+  and the registers hold one and two complex values.
+
+  The kernels are compiled with the target attribute, so the rest of the
+  program is compiled for the plain cpu, and the AVX2 ones are only used
+  if the cpu has them. The environment variable MAMMUT_SIMD can be set to
+  "none", "sse2" or "avx2" to force a set of kernels.
+
+  Needs gcc 4.9 or clang on x86. Other compilers get the plain C kernels.
+*/
+
+
+#if defined(__x86_64__) || defined(__i386__)
+#  if defined(__clang__) || __GNUC__>4 || (__GNUC__==4 && __GNUC_MINOR__>=9)
+#    define FFT_SIMD 1
+#  endif
+#endif
+
+
+#ifdef FFT_SIMD
+
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2,fma")))
+
+
+#ifndef MAMMUT_DOUBLE
+
+
+/* SSE2 */
+
+/* Multiplied with, flips the sign of the real (even) or imaginary (odd) floats.
+   Sign bit masks are not used, since --fast-math does not keep them. */
+static inline SSE2 __m128 sse_signs(float even,float odd){
+  return _mm_set_ps(odd,even,odd,even);
+}
+
+/* w*x. wi must already have the sign of the transform. */
+static inline SSE2 __m128 sse_cmul(__m128 w,__m128 x,__m128 sign,__m128 evenneg){
+  __m128 wr=_mm_shuffle_ps(w,w,_MM_SHUFFLE(2,2,0,0));
+  __m128 wi=_mm_mul_ps(_mm_shuffle_ps(w,w,_MM_SHUFFLE(3,3,1,1)),sign);
+  __m128 xs=_mm_shuffle_ps(x,x,_MM_SHUFFLE(2,3,0,1));
+  return _mm_add_ps(_mm_mul_ps(wr,x),_mm_mul_ps(_mm_mul_ps(wi,xs),evenneg));
+}
+
+/* i*x or -i*x, depending on the signs. */
+static inline SSE2 __m128 sse_muli(__m128 x,__m128 signs){
+  return _mm_mul_ps(_mm_shuffle_ps(x,x,_MM_SHUFFLE(2,3,0,1)),signs);
+}
+
+static inline SSE2 void sse_radix2(float *x0,float *x1,const float *w,__m128 sign,__m128 evenneg){
+  __m128 t=sse_cmul(_mm_loadu_ps(w),_mm_loadu_ps(x1),sign,evenneg);
+  __m128 a=_mm_loadu_ps(x0);
+  _mm_storeu_ps(x0,_mm_add_ps(a,t));
+  _mm_storeu_ps(x1,_mm_sub_ps(a,t));
+}
+
+static inline SSE2 void sse_radix4(float *x0,float *x1,float *x2,float *x3,const float *w1,const float *w2,
+				   __m128 sign,__m128 evenneg,__m128 isigns)
+{
+  __m128 vw1=_mm_loadu_ps(w1);
+  __m128 vw2=_mm_loadu_ps(w2);
+  __m128 a0=_mm_loadu_ps(x0);
+  __m128 a2=_mm_loadu_ps(x2);
+  __m128 t,b0,b1,b2,b3;
+
+  t=sse_cmul(vw1,_mm_loadu_ps(x1),sign,evenneg);
+  b0=_mm_add_ps(a0,t);
+  b1=_mm_sub_ps(a0,t);
+  t=sse_cmul(vw1,_mm_loadu_ps(x3),sign,evenneg);
+  b2=_mm_add_ps(a2,t);
+  b3=_mm_sub_ps(a2,t);
+
+  t=sse_cmul(vw2,b2,sign,evenneg);
+  _mm_storeu_ps(x0,_mm_add_ps(b0,t));
+  _mm_storeu_ps(x2,_mm_sub_ps(b0,t));
+  t=sse_muli(sse_cmul(vw2,b3,sign,evenneg),isigns);
+  _mm_storeu_ps(x1,_mm_add_ps(b1,t));
+  _mm_storeu_ps(x3,_mm_sub_ps(b1,t));
+}
+
+/* The general iteration of the real-spectrum pass, for the complex values
+   i,i+1 and N-i,N-i-1. See rfft_kernel in fft.c. */
+static inline SSE2 void sse_real(float *xa,float *xb,const float *w,__m128 c1,__m128 c2,
+				 __m128 sign,__m128 evenneg,__m128 oddneg)
+{
+  __m128 a=_mm_loadu_ps(xa);
+  __m128 b=_mm_loadu_ps(xb);
+  __m128 bc,h1,h2,p,r;
+
+  bc=_mm_mul_ps(_mm_shuffle_ps(b,b,_MM_SHUFFLE(1,0,3,2)),oddneg);
+  h1=_mm_mul_ps(c1,_mm_add_ps(a,bc));
+  h2=_mm_mul_ps(c2,sse_muli(_mm_sub_ps(a,bc),evenneg));
+  p=sse_cmul(_mm_loadu_ps(w),h2,sign,evenneg);
+
+  _mm_storeu_ps(xa,_mm_add_ps(h1,p));
+  r=_mm_mul_ps(_mm_sub_ps(h1,p),oddneg);
+  _mm_storeu_ps(xb,_mm_shuffle_ps(r,r,_MM_SHUFFLE(1,0,3,2)));
+}
+
+
+static SSE2 int radix2_sse2(float *x,long h,const float *w,int num,float fsign){
+  __m128 sign=_mm_set1_ps(fsign);
+  __m128 evenneg=sse_signs(-1.f,1.f);
+  float *x1=x+2*h;
+  int k;
+
+  for(k=0;k+2<=num;k+=2)
+    sse_radix2(x+2*k,x1+2*k,w+2*k,sign,evenneg);
+
+  return k;
+}
+
+static SSE2 int radix4_sse2(float *x,long h,const float *w1,const float *w2,int num,float fsign){
+  __m128 sign=_mm_set1_ps(fsign);
+  __m128 evenneg=sse_signs(-1.f,1.f);
+  __m128 isigns=fsign>0 ? evenneg : sse_signs(1.f,-1.f);
+  float *x1=x+2*h, *x2=x+4*h, *x3=x+6*h;
+  int k;
+
+  for(k=0;k+2<=num;k+=2)
+    sse_radix4(x+2*k,x1+2*k,x2+2*k,x3+2*k,w1+2*k,w2+2*k,sign,evenneg,isigns);
+
+  return k;
+}
+
+static SSE2 int real_sse2(float *x,long N,long i,const float *w,int num,float fc1,float fc2,float fsign){
+  __m128 c1=_mm_set1_ps(fc1);
+  __m128 c2=_mm_set1_ps(fc2);
+  __m128 sign=_mm_set1_ps(fsign);
+  __m128 evenneg=sse_signs(-1.f,1.f);
+  __m128 oddneg=sse_signs(1.f,-1.f);
+  int k;
+
+  /* Only while both values are below the middle, so that the two ends do not overlap. */
+  for(k=0;k+2<=num && 2*(i+k+1)<N;k+=2)
+    sse_real(x+2*(i+k),x+2*(N-i-k-1),w+2*k,c1,c2,sign,evenneg,oddneg);
+
+  return k;
+}
+
+
+
+/* AVX2 + FMA */
+
+static inline AVX2 __m256 avx_signs(float even,float odd){
+  return _mm256_set_ps(odd,even,odd,even,odd,even,odd,even);
+}
+
+static inline AVX2 __m256 avx_cmul(__m256 w,__m256 x,__m256 sign){
+  __m256 wr=_mm256_moveldup_ps(w);
+  __m256 wi=_mm256_mul_ps(_mm256_movehdup_ps(w),sign);
+  __m256 xs=_mm256_permute_ps(x,_MM_SHUFFLE(2,3,0,1));
+  return _mm256_fmaddsub_ps(wr,x,_mm256_mul_ps(wi,xs));
+}
+
+static inline AVX2 __m256 avx_muli(__m256 x,__m256 signs){
+  return _mm256_mul_ps(_mm256_permute_ps(x,_MM_SHUFFLE(2,3,0,1)),signs);
+}
+
+/* Reverses the order of the four complex values. */
+static inline AVX2 __m256 avx_reverse(__m256 x){
+  return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(x),_MM_SHUFFLE(0,1,2,3)));
+}
+
+
+static AVX2 int radix2_avx2(float *x,long h,const float *w,int num,float fsign){
+  __m256 sign=_mm256_set1_ps(fsign);
+  float *x1=x+2*h;
+  int k;
+
+  for(k=0;k+4<=num;k+=4){
+    __m256 t=avx_cmul(_mm256_loadu_ps(w+2*k),_mm256_loadu_ps(x1+2*k),sign);
+    __m256 a=_mm256_loadu_ps(x+2*k);
+    _mm256_storeu_ps(x+2*k,_mm256_add_ps(a,t));
+    _mm256_storeu_ps(x1+2*k,_mm256_sub_ps(a,t));
+  }
+
+  if(k+2<=num){
+    sse_radix2(x+2*k,x1+2*k,w+2*k,_mm_set1_ps(fsign),sse_signs(-1.f,1.f));
+    k+=2;
+  }
+
+  return k;
+}
+
+static AVX2 int radix4_avx2(float *x,long h,const float *w1,const float *w2,int num,float fsign){
+  __m256 sign=_mm256_set1_ps(fsign);
+  __m256 isigns=fsign>0 ? avx_signs(-1.f,1.f) : avx_signs(1.f,-1.f);
+  float *x0=x, *x1=x+2*h, *x2=x+4*h, *x3=x+6*h;
+  int k;
+
+  for(k=0;k+4<=num;k+=4){
+    __m256 vw1=_mm256_loadu_ps(w1+2*k);
+    __m256 vw2=_mm256_loadu_ps(w2+2*k);
+    __m256 a0=_mm256_loadu_ps(x0+2*k);
+    __m256 a2=_mm256_loadu_ps(x2+2*k);
+    __m256 t,b0,b1,b2,b3;
+
+    t=avx_cmul(vw1,_mm256_loadu_ps(x1+2*k),sign);
+    b0=_mm256_add_ps(a0,t);
+    b1=_mm256_sub_ps(a0,t);
+    t=avx_cmul(vw1,_mm256_loadu_ps(x3+2*k),sign);
+    b2=_mm256_add_ps(a2,t);
+    b3=_mm256_sub_ps(a2,t);
+
+    t=avx_cmul(vw2,b2,sign);
+    _mm256_storeu_ps(x0+2*k,_mm256_add_ps(b0,t));
+    _mm256_storeu_ps(x2+2*k,_mm256_sub_ps(b0,t));
+    t=avx_muli(avx_cmul(vw2,b3,sign),isigns);
+    _mm256_storeu_ps(x1+2*k,_mm256_add_ps(b1,t));
+    _mm256_storeu_ps(x3+2*k,_mm256_sub_ps(b1,t));
+  }
+
+  if(k+2<=num){
+    __m128 evenneg=sse_signs(-1.f,1.f);
+    sse_radix4(x0+2*k,x1+2*k,x2+2*k,x3+2*k,w1+2*k,w2+2*k,_mm_set1_ps(fsign),evenneg,
+	       fsign>0 ? evenneg : sse_signs(1.f,-1.f));
+    k+=2;
+  }
+
+  return k;
+}
+
+static AVX2 int real_avx2(float *x,long N,long i,const float *w,int num,float fc1,float fc2,float fsign){
+  __m256 c1=_mm256_set1_ps(fc1);
+  __m256 c2=_mm256_set1_ps(fc2);
+  __m256 sign=_mm256_set1_ps(fsign);
+  __m256 evenneg=avx_signs(-1.f,1.f);
+  __m256 oddneg=avx_signs(1.f,-1.f);
+  int k;
+
+  for(k=0;k+4<=num && 2*(i+k+3)<N;k+=4){
+    float *xa=x+2*(i+k), *xb=x+2*(N-i-k-3);
+    __m256 a=_mm256_loadu_ps(xa);
+    __m256 bc=_mm256_mul_ps(avx_reverse(_mm256_loadu_ps(xb)),oddneg);
+    __m256 h1=_mm256_mul_ps(c1,_mm256_add_ps(a,bc));
+    __m256 h2=_mm256_mul_ps(c2,avx_muli(_mm256_sub_ps(a,bc),evenneg));
+    __m256 p=avx_cmul(_mm256_loadu_ps(w+2*k),h2,sign);
+
+    _mm256_storeu_ps(xa,_mm256_add_ps(h1,p));
+    _mm256_storeu_ps(xb,avx_reverse(_mm256_mul_ps(_mm256_sub_ps(h1,p),oddneg)));
+  }
+
+  return k + real_sse2(x,N,i+k,w+2*k,num-k,fc1,fc2,fsign);
+}
+
+#else /* MAMMUT_DOUBLE */
+
+
+
+/* SSE2, double */
+
+static inline SSE2 __m128d sse_signs(double even,double odd){
+  return _mm_set_pd(odd,even);
+}
+
+static inline SSE2 __m128d sse_cmul(__m128d w,__m128d x,__m128d sign,__m128d evenneg){
+  __m128d wr=_mm_unpacklo_pd(w,w);
+  __m128d wi=_mm_mul_pd(_mm_unpackhi_pd(w,w),sign);
+  __m128d xs=_mm_shuffle_pd(x,x,1);
+  return _mm_add_pd(_mm_mul_pd(wr,x),_mm_mul_pd(_mm_mul_pd(wi,xs),evenneg));
+}
+
+static inline SSE2 __m128d sse_muli(__m128d x,__m128d signs){
+  return _mm_mul_pd(_mm_shuffle_pd(x,x,1),signs);
+}
+
+static inline SSE2 void sse_radix2(double *x0,double *x1,const double *w,__m128d sign,__m128d evenneg){
+  __m128d t=sse_cmul(_mm_loadu_pd(w),_mm_loadu_pd(x1),sign,evenneg);
+  __m128d a=_mm_loadu_pd(x0);
+  _mm_storeu_pd(x0,_mm_add_pd(a,t));
+  _mm_storeu_pd(x1,_mm_sub_pd(a,t));
+}
+
+static inline SSE2 void sse_radix4(double *x0,double *x1,double *x2,double *x3,const double *w1,const double *w2,
+				   __m128d sign,__m128d evenneg,__m128d isigns)
+{
+  __m128d vw1=_mm_loadu_pd(w1);
+  __m128d vw2=_mm_loadu_pd(w2);
+  __m128d a0=_mm_loadu_pd(x0);
+  __m128d a2=_mm_loadu_pd(x2);
+  __m128d t,b0,b1,b2,b3;
+
+  t=sse_cmul(vw1,_mm_loadu_pd(x1),sign,evenneg);
+  b0=_mm_add_pd(a0,t);
+  b1=_mm_sub_pd(a0,t);
+  t=sse_cmul(vw1,_mm_loadu_pd(x3),sign,evenneg);
+  b2=_mm_add_pd(a2,t);
+  b3=_mm_sub_pd(a2,t);
+
+  t=sse_cmul(vw2,b2,sign,evenneg);
+  _mm_storeu_pd(x0,_mm_add_pd(b0,t));
+  _mm_storeu_pd(x2,_mm_sub_pd(b0,t));
+  t=sse_muli(sse_cmul(vw2,b3,sign,evenneg),isigns);
+  _mm_storeu_pd(x1,_mm_add_pd(b1,t));
+  _mm_storeu_pd(x3,_mm_sub_pd(b1,t));
+}
+
+/* The general iteration of the real-spectrum pass, for the complex values
+   i and N-i. */
+static inline SSE2 void sse_real(double *xa,double *xb,const double *w,__m128d c1,__m128d c2,
+				 __m128d sign,__m128d evenneg,__m128d oddneg)
+{
+  __m128d a=_mm_loadu_pd(xa);
+  __m128d bc=_mm_mul_pd(_mm_loadu_pd(xb),oddneg);
+  __m128d h1=_mm_mul_pd(c1,_mm_add_pd(a,bc));
+  __m128d h2=_mm_mul_pd(c2,sse_muli(_mm_sub_pd(a,bc),evenneg));
+  __m128d p=sse_cmul(_mm_loadu_pd(w),h2,sign,evenneg);
+
+  _mm_storeu_pd(xa,_mm_add_pd(h1,p));
+  _mm_storeu_pd(xb,_mm_mul_pd(_mm_sub_pd(h1,p),oddneg));
+}
+
+
+static SSE2 int radix2_sse2(double *x,long h,const double *w,int num,double fsign){
+  __m128d sign=_mm_set1_pd(fsign);
+  __m128d evenneg=sse_signs(-1.,1.);
+  double *x1=x+2*h;
+  int k;
+
+  for(k=0;k<num;k++)
+    sse_radix2(x+2*k,x1+2*k,w+2*k,sign,evenneg);
+
+  return k;
+}
+
+static SSE2 int radix4_sse2(double *x,long h,const double *w1,const double *w2,int num,double fsign){
+  __m128d sign=_mm_set1_pd(fsign);
+  __m128d evenneg=sse_signs(-1.,1.);
+  __m128d isigns=fsign>0 ? evenneg : sse_signs(1.,-1.);
+  double *x1=x+2*h, *x2=x+4*h, *x3=x+6*h;
+  int k;
+
+  for(k=0;k<num;k++)
+    sse_radix4(x+2*k,x1+2*k,x2+2*k,x3+2*k,w1+2*k,w2+2*k,sign,evenneg,isigns);
+
+  return k;
+}
+
+static SSE2 int real_sse2(double *x,long N,long i,const double *w,int num,double fc1,double fc2,double fsign){
+  __m128d c1=_mm_set1_pd(fc1);
+  __m128d c2=_mm_set1_pd(fc2);
+  __m128d sign=_mm_set1_pd(fsign);
+  __m128d evenneg=sse_signs(-1.,1.);
+  __m128d oddneg=sse_signs(1.,-1.);
+  int k;
+
+  for(k=0;k<num && 2*(i+k)<N;k++)
+    sse_real(x+2*(i+k),x+2*(N-i-k),w+2*k,c1,c2,sign,evenneg,oddneg);
+
+  return k;
+}
+
+
+
+/* AVX2 + FMA, double */
+
+static inline AVX2 __m256d avx_signs(double even,double odd){
+  return _mm256_set_pd(odd,even,odd,even);
+}
+
+static inline AVX2 __m256d avx_cmul(__m256d w,__m256d x,__m256d sign){
+  __m256d wr=_mm256_movedup_pd(w);
+  __m256d wi=_mm256_mul_pd(_mm256_permute_pd(w,0xf),sign);
+  __m256d xs=_mm256_permute_pd(x,0x5);
+  return _mm256_fmaddsub_pd(wr,x,_mm256_mul_pd(wi,xs));
+}
+
+static inline AVX2 __m256d avx_muli(__m256d x,__m256d signs){
+  return _mm256_mul_pd(_mm256_permute_pd(x,0x5),signs);
+}
+
+/* Swaps the two complex values. */
+static inline AVX2 __m256d avx_reverse(__m256d x){
+  return _mm256_permute2f128_pd(x,x,1);
+}
+
+
+static AVX2 int radix2_avx2(double *x,long h,const double *w,int num,double fsign){
+  __m256d sign=_mm256_set1_pd(fsign);
+  double *x1=x+2*h;
+  int k;
+
+  for(k=0;k+2<=num;k+=2){
+    __m256d t=avx_cmul(_mm256_loadu_pd(w+2*k),_mm256_loadu_pd(x1+2*k),sign);
+    __m256d a=_mm256_loadu_pd(x+2*k);
+    _mm256_storeu_pd(x+2*k,_mm256_add_pd(a,t));
+    _mm256_storeu_pd(x1+2*k,_mm256_sub_pd(a,t));
+  }
+
+  return k + radix2_sse2(x+2*k,h,w+2*k,num-k,fsign);
+}
+
+static AVX2 int radix4_avx2(double *x,long h,const double *w1,const double *w2,int num,double fsign){
+  __m256d sign=_mm256_set1_pd(fsign);
+  __m256d isigns=fsign>0 ? avx_signs(-1.,1.) : avx_signs(1.,-1.);
+  double *x0=x, *x1=x+2*h, *x2=x+4*h, *x3=x+6*h;
+  int k;
+
+  for(k=0;k+2<=num;k+=2){
+    __m256d vw1=_mm256_loadu_pd(w1+2*k);
+    __m256d vw2=_mm256_loadu_pd(w2+2*k);
+    __m256d a0=_mm256_loadu_pd(x0+2*k);
+    __m256d a2=_mm256_loadu_pd(x2+2*k);
+    __m256d t,b0,b1,b2,b3;
+
+    t=avx_cmul(vw1,_mm256_loadu_pd(x1+2*k),sign);
+    b0=_mm256_add_pd(a0,t);
+    b1=_mm256_sub_pd(a0,t);
+    t=avx_cmul(vw1,_mm256_loadu_pd(x3+2*k),sign);
+    b2=_mm256_add_pd(a2,t);
+    b3=_mm256_sub_pd(a2,t);
+
+    t=avx_cmul(vw2,b2,sign);
+    _mm256_storeu_pd(x0+2*k,_mm256_add_pd(b0,t));
+    _mm256_storeu_pd(x2+2*k,_mm256_sub_pd(b0,t));
+    t=avx_muli(avx_cmul(vw2,b3,sign),isigns);
+    _mm256_storeu_pd(x1+2*k,_mm256_add_pd(b1,t));
+    _mm256_storeu_pd(x3+2*k,_mm256_sub_pd(b1,t));
+  }
+
+  return k + radix4_sse2(x+2*k,h,w1+2*k,w2+2*k,num-k,fsign);
+}
+
+static AVX2 int real_avx2(double *x,long N,long i,const double *w,int num,double fc1,double fc2,double fsign){
+  __m256d c1=_mm256_set1_pd(fc1);
+  __m256d c2=_mm256_set1_pd(fc2);
+  __m256d sign=_mm256_set1_pd(fsign);
+  __m256d evenneg=avx_signs(-1.,1.);
+  __m256d oddneg=avx_signs(1.,-1.);
+  int k;
+
+  for(k=0;k+2<=num && 2*(i+k+1)<N;k+=2){
+    double *xa=x+2*(i+k), *xb=x+2*(N-i-k-1);
+    __m256d a=_mm256_loadu_pd(xa);
+    __m256d bc=_mm256_mul_pd(avx_reverse(_mm256_loadu_pd(xb)),oddneg);
+    __m256d h1=_mm256_mul_pd(c1,_mm256_add_pd(a,bc));
+    __m256d h2=_mm256_mul_pd(c2,avx_muli(_mm256_sub_pd(a,bc),evenneg));
+    __m256d p=avx_cmul(_mm256_loadu_pd(w+2*k),h2,sign);
+
+    _mm256_storeu_pd(xa,_mm256_add_pd(h1,p));
+    _mm256_storeu_pd(xb,avx_reverse(_mm256_mul_pd(_mm256_sub_pd(h1,p),oddneg)));
+  }
+
+  return k + real_sse2(x,N,i+k,w+2*k,num-k,fc1,fc2,fsign);
+}
+
+#endif /* MAMMUT_DOUBLE */
+
+#endif /* FFT_SIMD */
+
+
+
+void FFTSIMD_init(struct FFT_Kernels *kernels){
+  kernels->name="c";
+  kernels->radix2=NULL;
+  kernels->radix4=NULL;
+  kernels->real=NULL;
+
+#ifdef FFT_SIMD
+  char *env=getenv("MAMMUT_SIMD");
+
+  if(env!=NULL && !strcmp(env,"none"))
+    return;
+
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && (env==NULL || !strcmp(env,"avx2"))){
+    kernels->name="avx2";
+    kernels->radix2=radix2_avx2;
+    kernels->radix4=radix4_avx2;
+    kernels->real=real_avx2;
+  }else if(__builtin_cpu_supports("sse2")){
+    kernels->name="sse2";
+    kernels->radix2=radix2_sse2;
+    kernels->radix4=radix4_sse2;
+    kernels->real=real_sse2;
+  }
+#endif
+}
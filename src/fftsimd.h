@@ -0,0 +1,17 @@
+
+/* Vectorized versions of the butterfly and real-spectrum kernels in fft.c.
+   Each kernel does as much of its range as it can, and returns how many
+   values it did. The caller does the rest with the plain C kernel. */
+
+typedef int (*FFT_radix2_kernel)(mammut_float *x, long h, const mammut_float *w, int num, mammut_float sign);
+typedef int (*FFT_radix4_kernel)(mammut_float *x, long h, const mammut_float *w1, const mammut_float *w2, int num, mammut_float sign);
+typedef int (*FFT_real_kernel)(mammut_float *x, long N, long i, const mammut_float *w, int num, mammut_float c1, mammut_float c2, mammut_float sign);
+
+struct FFT_Kernels{
+  const char *name;
+  FFT_radix2_kernel radix2;
+  FFT_radix4_kernel radix4;
+  FFT_real_kernel real;
+};
+
+extern LANGSPEC void FFTSIMD_init(struct FFT_Kernels *kernels);
@@ -12,14 +12,15 @@ int  samp_type;
 int  vers;
 long framecnt, N=0;
 
-float *lyd=NULL, *lyd2=NULL;
+mammut_float *lyd=NULL;
 
 float duration;		    /* Duration in secs */
 int numchannels;	    /* Number of FFT channels */
 float binfreq;		    /* Frequency pr. bin */
 int R=44100;
 
-int playing=0, theheight=400, dobler=0, zoom=0, leftkc=0;
+int playing=0, theheight=400, dobler=0;
+double view_lowfreq=0.0, view_highfreq=0.0;  /* Visible part of the spectrum, in Hz. See gui.cpp. */
 char playfile[200];
 
 bool isprocessing=false;
@@ -31,4 +32,7 @@ bool prefs_picture=true;
 bool prefs_animation=true;
 bool prefs_movingcamera=false;
 bool prefs_loop=true;
+bool prefs_spectrumondisk=false;
+bool prefs_preresample=false;
+bool prefs_preview=true;
 
@@ -1,6 +1,7 @@
 
 #include "mammut.h"
 #include "gui.h"
+#include "magpyramid.h"
 
 #include "juce.h"
 
@@ -8,12 +9,14 @@
 #  include "Interface.h"
 
 #define STARTX 20
+#define GRAPHWIDTH 800
+
+// The narrowest view, in bins. A bin is then GRAPHWIDTH/MINVIEWBINS pixels wide.
+#define MINVIEWBINS 8
 
 static GraphComponent *graphcomponent;
 static Interface *interface;
 
-static Image *image=NULL;
-
 //extern ThreadWithProgressWindow das_mytask;
 
 void GUI_addUndo(void){
@@ -41,37 +44,173 @@ void GUI_progressbar(int minvalue,int newvalue,int maxvalue){
 #endif
 
 
-void drawscale(Graphics *g)
+/*
+  The graph shows the spectrum from view_lowfreq to view_highfreq (Hz),
+  which can be anything from the whole spectrum down to MINVIEWBINS bins.
+  GUI_clampView moves a view inside a spectrum of n values (sampled at
+  samplerate), which is also what makes the initial 0,0 view show all of it.
+*/
+
+static void GUI_clampView(double *lowfreq,double *highfreq,long n,int samplerate){
+  double nyquist=samplerate/2.0;
+  double minwidth=n>0 ? MINVIEWBINS*(double)samplerate/n : 0.0;
+  double width=*highfreq-*lowfreq;
+
+  if(width<=0.0 || width>nyquist)
+    width=nyquist;
+  if(width<minwidth)
+    width=minwidth;
+
+  if(*lowfreq+width>nyquist)
+    *lowfreq=nyquist-width;
+  if(*lowfreq<0.0)
+    *lowfreq=0.0;
+
+  *highfreq=*lowfreq+width;
+}
+
+static void GUI_checkView(void){
+  GUI_clampView(&view_lowfreq,&view_highfreq,N,R);
+}
+
+void GUI_setView(double lowfreq,double highfreq){
+  view_lowfreq=lowfreq;
+  view_highfreq=highfreq;
+  RedrawWin();
+}
+
+bool GUI_isZoomed(void){
+  GUI_checkView();
+  return view_highfreq-view_lowfreq < R/2.0;
+}
+
+static double GUI_xToFreq(int x){
+  return view_lowfreq+(x-STARTX-10)*(view_highfreq-view_lowfreq)/GRAPHWIDTH;
+}
+
+
+// Mouse handling. Called from juce. (in graphcomponent.h)
+
+static int dragx;
+static double draglowfreq, draghighfreq;
+
+void GUI_mouseDown(int x){
+  GUI_checkView();
+  dragx=x;
+  draglowfreq=view_lowfreq;
+  draghighfreq=view_highfreq;
+}
+
+// Drags the spectrum along with the mouse.
+void GUI_mouseDrag(int x){
+  double hz=(x-dragx)*(draghighfreq-draglowfreq)/GRAPHWIDTH;
+  GUI_setView(draglowfreq-hz,draghighfreq-hz);
+}
+
+// Zooms in or out around the frequency under the mouse.
+void GUI_mouseWheel(int x,float increment){
+  double factor=pow(2.0,increment*5.0);
+  double freq;
+
+  GUI_checkView();
+  freq=GUI_xToFreq(x);
+  GUI_setView(freq-(freq-view_lowfreq)/factor,freq+(view_highfreq-freq)/factor);
+}
+
+void GUI_mouseDoubleClick(void){
+  GUI_setView(0.0,R/2.0);
+}
+
+
+// Hz between ticks on the frequency scale: 1, 2 or 5 times a power of ten, and at least 36 pixels apart.
+static double tickstep(double width){
+  double step=pow(10.0,floor(log10(width*36/GRAPHWIDTH)));
+  while(step*GRAPHWIDTH/width<36){
+    if(step*GRAPHWIDTH*2/width>=36)
+      return step*2;
+    if(step*GRAPHWIDTH*5/width>=36)
+      return step*5;
+    step*=10;
+  }
+  return step;
+}
+
+/*
+  Drawing is done by the renderer thread, so RedrawWin can be called from
+  any thread and never waits for it. RedrawWin stores the view and wakes
+  the renderer up. Redraws asked for while it draws are done once, after.
+
+  The renderer holds spectrumlock only while it reads the spectrum into a
+  snapshot (the height of each column), and the same lock is held while
+  the spectrum is changed (GUI_lockSpectrum). It then draws the snapshot
+  into the back image and swaps it with the front image, which is the one
+  BlitWin paints.
+*/
+
+struct GUI_Snapshot{
+  double lowfreq,highfreq;
+  int channels;
+  int height;
+  int *columns;			/* columns[ch*GRAPHWIDTH+x] is the line height at x, or -1 for no line. */
+};
+
+static CriticalSection spectrumlock;
+static CriticalSection requestlock;
+static CriticalSection imagelock;
+
+static double request_lowfreq, request_highfreq;
+static int requests=0;
+
+static Image *images[2]={NULL,NULL};
+static int front=0;
+
+
+void GUI_lockSpectrum(void){
+  spectrumlock.enter();
+}
+
+void GUI_unlockSpectrum(void){
+  spectrumlock.exit();
+}
+
+
+void drawscale(Graphics *g,struct GUI_Snapshot *s)
 {
   int i, grafx, ch;
-  char tall[10];
-  bool havefile=samps_per_frame!=0?false:true;
+  char tall[32];
+  bool havefile=s->channels!=0?false:true;
   int startx=havefile==true?STARTX-10:STARTX;
 
   g->setColour(Colours::darkgrey);
     
-  g->drawLine(startx,theheight+20,
-	      850,theheight+20);
-  g->drawLine(startx,theheight+20,
+  g->drawLine(startx,s->height+20,
+	      850,s->height+20);
+  g->drawLine(startx,s->height+20,
 	      startx,10);
 
-  for (i=0; i<=(int)(R/2000.); i++) {
-    grafx=(int)(i*1600000./R)+STARTX+10;
-    g->drawLine(grafx,theheight+15,grafx,theheight+25);
-    if (zoom) {
-      if ((i%2==0) && (i>0) && (i<22)) {
-	sprintf(tall, "%d", i*100+leftkc*1000);
-	g->drawSingleLineText(tall,grafx-14,theheight+40);
-      }
-    } else {
-      sprintf(tall, "%d", i);
-      g->drawSingleLineText(tall,grafx-6,theheight+40);
+  // kHz when the ticks are whole kHz, otherwise Hz on every other tick.
+  {
+    double width=s->highfreq-s->lowfreq;
+    double step=tickstep(width);
+    int decimals=step>=1.0 ? 0 : (int)ceil(-log10(step));
+    long tick;
+
+    for (tick=(long)ceil(s->lowfreq/step); tick*step<=s->highfreq; tick++) {
+      grafx=(int)((tick*step-s->lowfreq)*GRAPHWIDTH/width)+STARTX+10;
+      g->drawLine(grafx,s->height+15,grafx,s->height+25);
+      if (step>=1000.0)
+	sprintf(tall, "%d", (int)(tick*step/1000.0+0.5));
+      else if (tick%2==0)
+	sprintf(tall, "%.*f", decimals, tick*step);
+      else
+	continue;
+      g->drawSingleLineText(tall,grafx-g->getCurrentFont().getStringWidth(tall)/2,s->height+40);
     }
   }
     
-  for (ch=0; ch<samps_per_frame; ch++) {
+  for (ch=0; ch<s->channels; ch++) {
     for (i=0; i<=10; i++) {
-      grafx = (ch+1)*theheight/samps_per_frame - i*35./samps_per_frame + 10;
+      grafx = (ch+1)*s->height/s->channels - i*35./s->channels + 10;
       g->drawLine(startx-5,grafx,startx+5,grafx);
       sprintf(tall, "%2d", i);
       g->drawSingleLineText(tall,0,grafx+5);
@@ -112,52 +251,140 @@ void RestoreWinAll(void){
 }
 
 
-static void DrawImage(void){
+// Bin i is drawn at pixel column floor((i-offset)*scale).
+static int bincolumn(long i,double offset,double scale){
+  return (int)floor((i-offset)*scale);
+}
 
-  long i;
-  int c0=0, y, grafx, grafold=-1, start, range,ch;
-  double real, imag, amp, maxamp=-1.;  
+// The first bin drawn at pixel column x or later, when each bin is scale pixels wide.
+static long firstbin(int x,double offset,double scale){
+  long i=(long)ceil(x/scale+offset);
+  while(i>0 && bincolumn(i-1,offset,scale)>=x)
+    i--;
+  while(bincolumn(i,offset,scale)<x)
+    i++;
+  return i;
+}
+
+// Reads the columns of the view in s from the spectrum. Called with spectrumlock held.
+static void GUI_takeSnapshot(struct GUI_Snapshot *s){
+  long i, lasti, start, range;
+  int grafx, ch;
+  double scale, offset, maxamp;
+  float minamp, amp;
+
+  s->channels=lyd==NULL ? 0 : samps_per_frame;
+  s->height=theheight;
+  s->columns=(int*)erroralloc(sizeof(int)*GRAPHWIDTH*mammut_max(s->channels,1));
+
+  GUI_clampView(&s->lowfreq,&s->highfreq,N,R);
+
+  // The view starts offset bins into bin start. Bins are counted from start below.
+  offset=s->lowfreq*N/R;
+  start=(long)offset;
+  offset-=start;
+  range=N/2-start-1;
+
+  // Each column shows the largest magnitude of the bins since the previous column, up to and including its own first bin.
+  // (Zoomed in far enough, that is one bin, and the columns between bins are left empty.)
+  // The magnitude pyramid makes this as fast for the whole spectrum as for a few bins.
+  scale=GRAPHWIDTH/((s->highfreq-s->lowfreq)*N/R);
+
+  for (ch=0; ch<s->channels; ch++) {
+    int *columns=s->columns+ch*GRAPHWIDTH;
+    lasti=-1;
+    for (grafx=0; grafx<GRAPHWIDTH; grafx++) {
+      columns[grafx]=-1;
+      i=firstbin(grafx,offset,scale);
+      if (i>=range) continue;
+      if (bincolumn(i,offset,scale)!=grafx) continue;
+      MP_getRange(ch,start+lasti+1,start+i+1,&minamp,&amp);
+      maxamp=amp*N/s->channels;
+      columns[grafx]=(int)(maxamp/10.);
+      lasti=i;
+    }
+  }
+}
+
+static void DrawImage(Image *image,struct GUI_Snapshot *s){
+  int y, grafx, ch;
 
   Graphics g(*image);
 
   image->clear(0,0,image->getWidth(),image->getHeight());
 
-  drawscale(&g);
+  drawscale(&g,s);
   
   g.setColour(Colours::black);
   
   //RestoreWinAll();
-  
-  start=(zoom==0?0:1000.*leftkc*N/R);
-  range=N/(zoom?20:2); if (start+range>=N/2) range=N/2-start-1;
 
   printf("I am drawing\n");
-  
-  for (ch=0; ch<samps_per_frame; ch++) {
-    for (i=0; i<range; i++) {
-      grafx = (int)(i*800./(N/(zoom?20.:2.)))+STARTX+10;
-      real=lyd[(i+start)*2+ch*N]; imag=lyd[(i+start)*2+1+ch*N];
-      amp=sqrt(real*real+imag*imag)*N;
-      if (amp>maxamp) maxamp=amp;
-      if (grafx!=grafold) {
-	maxamp/=samps_per_frame;
-	y = (ch+1)*theheight/samps_per_frame-(int)(maxamp/10.)+10;
-	g.drawLine(grafx,(ch+1)*theheight/samps_per_frame+10,grafx,y);
-	grafold=grafx;
-	maxamp=-1.;
-      }
+
+  for (ch=0; ch<s->channels; ch++) {
+    int *columns=s->columns+ch*GRAPHWIDTH;
+    int bottom=(ch+1)*s->height/s->channels+10;
+    for (grafx=0; grafx<GRAPHWIDTH; grafx++) {
+      if (columns[grafx]<0) continue;
+      y = bottom-columns[grafx];
+      g.drawLine(grafx+STARTX+10,bottom,grafx+STARTX+10,y);
     }
   }
-  
-  graphcomponent->repaint();
 }
 
 
+class SpectrumRenderer : public Thread
+{
+public:
+  SpectrumRenderer() : Thread(T("spectrumrenderer")) {
+  }
+
+  void run()
+  {
+    int rendered=0;
+
+    while(threadShouldExit()==false){
+      struct GUI_Snapshot s;
+      int request;
+
+      requestlock.enter();
+      request=requests;
+      s.lowfreq=request_lowfreq;
+      s.highfreq=request_highfreq;
+      requestlock.exit();
+
+      if(request==rendered){
+	wait(-1);
+	continue;
+      }
+
+      spectrumlock.enter();
+      GUI_takeSnapshot(&s);
+      spectrumlock.exit();
+
+      DrawImage(images[1-front],&s);
+      free(s.columns);
+
+      imagelock.enter();
+      front=1-front;
+      imagelock.exit();
+
+      rendered=request;
+      graphcomponent->triggerAsyncUpdate();
+    }
+  }
+};
+
+static SpectrumRenderer *renderer=NULL;
+
+
 
 // Called from juce. (in graphcomponent.h)
 void BlitWin(Graphics *g){
   //printf("painting\n");
-  g->drawImageAt(image,0,0,false);
+  imagelock.enter();
+  g->drawImageAt(images[front],0,0,false);
+  imagelock.exit();
   //printf("restoring\n");
 }
 
@@ -165,7 +392,14 @@ void BlitWin(Graphics *g){
 
 // Called from transforms, loaders, etc.
 void RedrawWin(void){
-  DrawImage();
+  requestlock.enter();
+  request_lowfreq=view_lowfreq;
+  request_highfreq=view_highfreq;
+  requests++;
+  requestlock.exit();
+
+  if(renderer!=NULL)
+    renderer->notify();
 }
 
 
@@ -174,7 +408,19 @@ void RedrawWin(void){
 void GUI_init(GraphComponent *das_graphcomponent,Interface *das_interface){
   graphcomponent=das_graphcomponent;
   interface=das_interface;
-  image=new Image(Image::ARGB,das_graphcomponent->getWidth(),das_graphcomponent->getHeight(),false);
+  images[0]=new Image(Image::ARGB,das_graphcomponent->getWidth(),das_graphcomponent->getHeight(),true);
+  images[1]=new Image(Image::ARGB,das_graphcomponent->getWidth(),das_graphcomponent->getHeight(),true);
+  renderer=new SpectrumRenderer();
+  renderer->startThread();
   RedrawWin();
   printf("GUI_init()\n");
 }
+
+// Called before the window is deleted.
+void GUI_exit(void){
+  if(renderer==NULL)
+    return;
+  renderer->stopThread(5000);
+  delete renderer;
+  renderer=NULL;
+}
@@ -9,6 +9,16 @@ The constructor first checks if the jack server is running. If not, it will use
 sound API instead. Erik de Castro Lopo's libsamplerate is used for resampling, in case
 resampling is needed.
 
+The sound is made by a feeder thread (JucePlayer::run), which resamples
+the source into a lock-free ring buffer (ringbuffer.c). The audio callback
+only copies out of the ring buffer, so it never touches the spectrum
+buffers and is not disturbed by transforms running at the same time.
+Stopping just stops the feeder thread, and does not wait for the callback.
+
+For large spectra, the player can start with a preview rendered from the
+lowest part of the spectrum (see RC_getPreview in render.c). The feeder
+swaps in the full sound at the same position when it is ready.
+
 Instructions:
 * The methods getSourceLength, getSourceData, getSourceRate, getSourceNumChannels, sourceInit,
   and sourceCleanup must be provided.
@@ -27,6 +37,8 @@ I'm sorry about all the non-C++ stuff. I'm not a big C++ fan.
 #include "juce.h"
 #include "mammut.h"
 #include "juceplay.h"
+#include "render.h"
+#include "ringbuffer.h"
 
 #include "oggsoundholder.h"
 #include <vorbis/codec.h>
@@ -42,6 +54,14 @@ I'm sorry about all the non-C++ stuff. I'm not a big C++ fan.
 #define JP_MIN(a,b) (((a)<(b))?(a):(b))
 #define JP_MAX(a,b) (((a)>(b))?(a):(b))
 
+// Frames the feeder thread renders at a time, and the size of the ring buffer.
+#define JP_BLOCKFRAMES 512
+#define JP_RINGFRAMES 8192
+
+// Spectra smaller than this are not previewed, since the full inverse fft is fast enough.
+#define JP_PREVIEWMINFRAMES (1<<21)
+#define JP_PREVIEWFACTOR 4
+
 
 extern LANGSPEC void audio_jack_callback (float ** 	inputChannelData, 
 					  int 	totalNumInputChannels, 
@@ -111,36 +131,68 @@ int jp_playpos;
 bool jp_isplaying=false;
 static float normalize_val;
 
+/* The sound being played. Made by RC_getSound, which only does the inverse fft if the spectrum has changed. */
+static mammut_float *sound=NULL;
+
+/* If the "Fast preview" pref is set and the spectrum is large, the sound is at first a
+   preview made by RC_getPreview, of N/preview_factor frames at R/preview_factor.
+   The feeder thread swaps in the full sound when it has been rendered in the background. */
+static int preview_factor=1;
+
+/* The sound resampled to play_samplerate, if the "Resample before playing" pref is set. Otherwise NULL. */
+static float **resampled=NULL;
+static long resampled_frames=0;
+static double play_samplerate;
+
+static int getPreviewFactor(void){
+  char *env=getenv("MAMMUT_PREVIEWFACTOR");
+  int factor=env==NULL ? JP_PREVIEWFACTOR : atoi(env);
+  return factor<2 ? JP_PREVIEWFACTOR : factor;
+}
+
 static void source_init(void){
-  int progval=0;
+  bool preresample = prefs_preresample==true && fabs(((double)R) - play_samplerate) > 0.1;
 
-  memcpy(lyd2,lyd,samps_per_frame*N*sizeof(float));
-  
-  for (int ch=0; ch<samps_per_frame; ch++) {
-    GUI_aboveprogressbar(ch,samps_per_frame); 
-    rfft(lyd+ch*N,  N/2,  INVERSE);
+  preview_factor=1;
+  resampled=NULL;
+
+  sound=RC_getSoundIfReady();
+
+  if(sound==NULL && prefs_preview==true && preresample==false && N>=JP_PREVIEWMINFRAMES){
+    int factor=getPreviewFactor();
+    sound=RC_getPreview(factor);
+    if(sound!=NULL){
+      preview_factor=factor;
+      normalize_val=RC_getNormalizeVal();
+      return;
+    }
   }
-  
-  normalize_val=get_normalize_val();
+
+  if(sound==NULL)
+    sound=RC_getSound();
+  normalize_val=RC_getNormalizeVal();
+
+  if(preresample)
+    resampled=RC_getResampled(play_samplerate,&resampled_frames);
   //fprintf(stderr,"source_init finished\n");
-  //if(synthandsave_normalize_gain)
-  //  normalize();
 }
 
-class JucePlayer : public AudioIODeviceCallback, public ChangeListener
+class JucePlayer : public AudioIODeviceCallback, public ChangeListener, public Thread
 {
   AudioDeviceManager audioDeviceManager;
   PropertiesFile *propertiesfile;
 
 public:
 
-  JucePlayer(PropertiesFile *propertiesfile)
+  JucePlayer(PropertiesFile *propertiesfile) : Thread(T("mammut player"))
   {
     this->propertiesfile=propertiesfile;
 
     jp_isplaying=false;
     isreadingdata=false;
+    isfeeding=false;
     pleasestop=false;
+    ring=NULL;
     isinitialized=false;
     isusingjack=false;
 
@@ -213,7 +265,7 @@ public:
   int getSourceLength(){
     if(isplaying_ogg)
       return ov_pcm_total(&oggvorbisfile,-1);
-    return N;
+    return N/preview_factor;
   }
   
   void getOggData(float **dst,int num_frames){
@@ -272,27 +324,56 @@ public:
     }
   }
 
+#ifdef MAMMUT_DOUBLE
+  // The spectrum is double, so the sound is converted to floats for the player.
   float *getSourceData(int channel,int position,int num_frames){
-    return lyd+(position+(channel*N));
+    static float **buffers=NULL;
+    static int num_buffers=0;
+    static int buffer_size=0;
+
+    if(getSourceNumChannels()>num_buffers || num_frames>buffer_size){
+      for(int ch=0;ch<num_buffers;ch++)
+	free(buffers[ch]);
+      free(buffers);
+      num_buffers=JP_MAX(num_buffers,getSourceNumChannels());
+      buffer_size=JP_MAX(buffer_size,num_frames);
+      buffers=(float**)erroralloc(sizeof(float*)*num_buffers);
+      for(int ch=0;ch<num_buffers;ch++)
+	buffers[ch]=(float*)erroralloc(sizeof(float)*buffer_size);
+    }
+
+    mammut_float *src=sound+(position+(channel*getSourceLength()));
+    for(int i=0;i<num_frames;i++)
+      buffers[channel][i]=src[i];
+
+    return buffers[channel];
+  }
+#else
+  float *getSourceData(int channel,int position,int num_frames){
+    return sound+(position+(channel*getSourceLength()));
   }
+#endif
   double getSourceRate(){
-    return (double)R;
+    return (double)R/preview_factor;
   }
   int getSourceNumChannels(){
     return samps_per_frame;
   }
   void sourceCleanup(){
-    memcpy(lyd,lyd2,getSourceNumChannels()*N*sizeof(float));
+    sound=NULL;
+    resampled=NULL;
+    preview_factor=1;
   }
 
   void insertDataResample(float **outdata,int frames,int num_channels){
     static float nulldata[512]={0.0f};
     int last_consumed=0;
     double ratio=samplerate/getSourceRate();
+    long num_in=mustrunonemore==true?512:JP_MIN((long)(64+1.2*frames/ratio),getSourceLength()-sourcepos);
     for(int ch=0;ch<num_channels;ch++){
       SRC_DATA src_data={
-	mustrunonemore==true?nulldata:getSourceData(ch,jp_playpos,1024), outdata[ch],
-	mustrunonemore==true?512:JP_MIN((long)(64+1.2*frames/ratio),getSourceLength()-jp_playpos), frames,
+	mustrunonemore==true?nulldata:getSourceData(ch,sourcepos,num_in), outdata[ch],
+	num_in, frames,
 	0,0,
 	0,
 	ratio
@@ -309,14 +390,14 @@ public:
 	  if(last_consumed>0){
 	    mustrunonemore=false;
 	    if(prefs_loop==true){
-	      jp_playpos=0;
+	      sourcepos=0;
 	    }else{
-	      isreadingdata=false;
+	      isfeeding=false;
 	    }
 	  }
 	}else{
-	  jp_playpos+=src_data.input_frames_used;
-	  if(jp_playpos>=getSourceLength())
+	  sourcepos+=src_data.input_frames_used;
+	  if(sourcepos>=getSourceLength())
 	    mustrunonemore=true;
 	}
 	//printf("running_more: %d, consumed: %d %f %d\n",mustrunonemore,last_consumed,rate,(int)(frames/rate));
@@ -324,28 +405,119 @@ public:
     }
   }
 
+  // Copies from the resampled sound. jp_playpos is still in frames of the source, since the gui uses it.
+  void insertDataPreresampled(float **outdata,int frames,int num_channels){
+    double ratio=(double)resampled_frames/getSourceLength();
+
+    // The gui may have moved the position.
+    if(jp_playpos!=lastplaypos)
+      resampledpos=(long)(jp_playpos*ratio);
+
+    int len = JP_MIN(frames, resampled_frames - resampledpos);
+    for(int ch=0;ch<num_channels;ch++){
+      memcpy(outdata[ch],resampled[ch]+resampledpos,sizeof(float)*len);
+      zeromem(outdata[ch]+len,sizeof(float)*(frames-len));
+    }
+
+    resampledpos+=frames;
+    if(resampledpos>=resampled_frames){
+      if(prefs_loop==true){
+	resampledpos=0;
+      }else{
+	isfeeding=false;
+      }
+    }
+
+    jp_playpos=lastplaypos=(int)(resampledpos/ratio);
+  }
+
   void insertData(float **outdata,int frames,int num_channels){
-    if(frames+jp_playpos <= getSourceLength()){
+    if(frames+sourcepos <= getSourceLength()){
       for(int ch=0;ch<num_channels;ch++){
-	memcpy(outdata[ch],getSourceData(ch,jp_playpos,frames),sizeof(float)*frames);
+	memcpy(outdata[ch],getSourceData(ch,sourcepos,frames),sizeof(float)*frames);
       }
     }else{
-      int len = getSourceLength() - jp_playpos;
+      int len = getSourceLength() - sourcepos;
       for(int ch=0;ch<num_channels;ch++){
-	memcpy(outdata[ch],getSourceData(ch,jp_playpos,len),sizeof(float)*len);
+	memcpy(outdata[ch],getSourceData(ch,sourcepos,len),sizeof(float)*len);
 	zeromem(outdata[ch]+len,sizeof(float)*(frames-len));
       }
     }
-    jp_playpos+=frames;
-    if(jp_playpos>=getSourceLength()){
+    sourcepos+=frames;
+    if(sourcepos>=getSourceLength()){
       if(prefs_loop==true){
-	jp_playpos=0;
+	sourcepos=0;
       }else{
-	isreadingdata=false;
+	isfeeding=false;
       }
     }
   }
 
+  // Called by the feeder thread while playing a preview. The preview and the full sound
+  // are the same sound at different samplerates, so playing just continues at the same place.
+  void swapInFullSound(){
+    mammut_float *full=RC_getSoundIfReady();
+    if(full==NULL || mustrunonemore==true)
+      return;
+
+    sound=full;
+
+    // Keep the level of the preview, unless the full sound would clip. (normalize_val leaves 10% headroom)
+    if(normalize_val > RC_getNormalizeVal()/0.9f)
+      normalize_val=RC_getNormalizeVal();
+    sourcepos*=preview_factor;
+    preview_factor=1;
+
+    for(int i=0;i<num_src_states;i++)
+      src_reset(src_states[i]);
+  }
+
+  // The feeder thread.
+  void run(){
+    int num_channels=getSourceNumChannels();
+    float **block=(float**)erroralloc(sizeof(float*)*num_channels);
+
+    for(int ch=0;ch<num_channels;ch++)
+      block[ch]=(float*)erroralloc(sizeof(float)*JP_BLOCKFRAMES);
+
+    while(threadShouldExit()==false){
+      if(isfeeding==false || RB_writeSpace(ring)<JP_BLOCKFRAMES){
+	wait(2);
+	continue;
+      }
+
+      if(resampled!=NULL){
+	insertDataPreresampled(block,JP_BLOCKFRAMES,num_channels);
+      }else{
+	// jp_playpos is in frames of the full sound, since the gui uses it.
+	if(jp_playpos!=lastplaypos)
+	  sourcepos=jp_playpos/preview_factor;
+
+	if(preview_factor>1)
+	  swapInFullSound();
+
+	if( (fabs(getSourceRate() - samplerate)) > 0.1){
+	  insertDataResample(block,JP_BLOCKFRAMES,num_channels);
+	}else{
+	  insertData(block,JP_BLOCKFRAMES,num_channels);
+	}
+
+	jp_playpos=lastplaypos=sourcepos*preview_factor;
+      }
+
+      if(synthandsave_normalize_gain)
+	for(int ch=0;ch<num_channels;ch++)
+	  for(int i=0;i<JP_BLOCKFRAMES;i++)
+	    block[ch][i]*=normalize_val;
+
+      RB_write(ring,block,JP_BLOCKFRAMES);
+    }
+
+    for(int ch=0;ch<num_channels;ch++)
+      free(block[ch]);
+    free(block);
+  }
+
   void audioDeviceIOCallback(const float ** 	inputChannelData, 
 			     int 	totalNumInputChannels, 
 			     float ** 	outputChannelData, 
@@ -389,17 +561,19 @@ public:
       return;
     }
 
-    if( (fabs(((double)R) - samplerate)) > 0.1){
-      insertDataResample(outputChannelData,numSamples,num_channels);
-    }else{
-      insertData(outputChannelData,numSamples,num_channels);
+    {
+      long available=RB_readSpace(ring);
+      int num_frames=RB_read(ring,outputChannelData,num_channels,JP_MIN(available,numSamples));
+
+      // If the feeder is behind, there is silence. If it has finished, so has the sound.
+      if(num_frames<numSamples){
+	for(int ch=0;ch<num_channels;ch++)
+	  zeromem(outputChannelData[ch]+num_frames, sizeof(float) * (numSamples-num_frames));
+	if(isfeeding==false)
+	  isreadingdata=false;
+      }
     }
 
-    if(synthandsave_normalize_gain)
-      for(int ch=0;ch<num_channels;ch++)
-	for(int i=0;i<numSamples;i++)
-	  outputChannelData[ch][i]*=normalize_val;
-
 
     // Play mono files in both loudspeakers.
     if(isplaying_ogg==false && getSourceNumChannels()==1 && totalNumOutputChannels>1)
@@ -423,6 +597,7 @@ public:
 
     stop();
 
+    play_samplerate=samplerate;
     GUI_newprocess(source_init);
     //source_init();
     //fprintf(stderr,"GUI_newprocess finished\n");
@@ -456,12 +631,29 @@ public:
       
       for(int ch=0;ch<num_channels;ch++)
 	src_states[ch]=src_new(SRC_QUALITY,1,&error);
+      num_src_states=num_channels;
     }
 
+    // The ring buffer is kept as long as the number of channels is the same, since the callback may still be reading it.
+    if(ring==NULL || ring_channels!=num_channels){
+      pleasestop=true;
+      for(int i=0;i<1000 && isreadingdata==true;i++)
+	Thread::sleep(1);
+      RB_delete(ring);
+      ring=RB_new(num_channels,JP_RINGFRAMES);
+      ring_channels=num_channels;
+    }else
+      RB_flush(ring);
+
     pleasestop=false;
     jp_playpos=0;
+    lastplaypos=0;
+    resampledpos=0;
+    sourcepos=0;
     mustrunonemore=false;
     jp_isplaying=true;
+    isfeeding=true;
+    startThread(8);
     isreadingdata=true;
   }
 
@@ -472,11 +664,10 @@ public:
       return;
     if(jp_isplaying==false)
       return;
-    if(isreadingdata==true){
-      pleasestop=true;
-      while(isreadingdata==true)
-	Time::waitForMillisecondCounter(Time::getApproximateMillisecondCounter()+100);
-    }
+    // The callback goes silent at its next call. It only reads the ring buffer, so there is no need to wait for it.
+    pleasestop=true;
+    stopThread(1000);
+    isfeeding=false;
 
     sourceCleanup();
 
@@ -528,7 +719,13 @@ private:
   bool mustrunonemore;
   BitArray *outchannels;
 
-  bool isreadingdata;
+  bool isreadingdata; // The callback plays from the ring buffer.
+  bool isfeeding; // The feeder thread has more to write to the ring buffer.
+  int lastplaypos;
+  long resampledpos;
+  int sourcepos; // Position in the sound being played, which is a preview if preview_factor>1.
+  struct RB_Ring *ring;
+  int ring_channels;
   bool isplaying_ogg;
   bool oggisresampling;
   SRC_STATE *oggsrc_state;
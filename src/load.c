@@ -1,5 +1,8 @@
 
 #include "mammut.h"
+#include "spectrummem.h"
+#include "spectrumcache.h"
+#include "dirty.h"
 
 
 /* Following code copied from Ceres. */
@@ -8,45 +11,198 @@ struct LoadStruct loadstruct;
 
 
 
-/* ly=destination, spf=samples per frame. */
+/* Frames decoded at a time. Can be changed with the environment variable MAMMUT_READFRAMES. */
+#define LOAD_BLOCKFRAMES 65536
 
-void readsound(struct LoadStruct *ls,float *ly, int channels)
+
+static int readsound_blockframes(void){
+  char *env=getenv("MAMMUT_READFRAMES");
+
+  if(env!=NULL && atoi(env)>0)
+    return atoi(env);
+
+  return LOAD_BLOCKFRAMES;
+}
+
+/* Puts the num frames in buf (interleaved) at position r in each channel. */
+static void readsound_deinterleave(mammut_float *ly, int channels, long size, long r, float *buf, int filechannels, int num){
+  int ch,lokke;
+
+  for(ch=0;ch<channels;ch++){
+    mammut_float *l=ly+ch*size+r;
+    float *b=buf+ch;
+    for(lokke=0;lokke<num;lokke++)
+      l[lokke]=b[lokke*filechannels];
+  }
+}
+
+
+static void readsound_serial(struct LoadStruct *ls,mammut_float *ly, int channels, long size)
 {
-  int ch;
-
-  static int lastchannels=0;
-  static float *val3 = NULL;
-  if(ls->sfinfo.channels>lastchannels){
-    free(val3);
-    val3 = malloc (sizeof(float)*(ls->sfinfo.channels*8192));
-    lastchannels=ls->sfinfo.channels;
+  int filechannels=ls->sfinfo.channels;
+  int blockframes=readsound_blockframes();
+  float *buf=erroralloc(sizeof(float)*filechannels*blockframes);
+  long r=0;
+
+  sf_seek(ls->infile,0,SEEK_SET);
+
+  while(r<size){
+    int ret=sf_readf_float(ls->infile,buf,mammut_min(blockframes,size-r));
+    if(ret<=0)
+      break;
+    readsound_deinterleave(ly,channels,size,r,buf,filechannels,ret);
+    r+=ret;
   }
 
-  for(ch=0;ch<channels;ch++){
-    float *l=ly+(ch*N);
-    int sampsread;
-    int r=0;
-    sf_seek(ls->infile,0,SEEK_SET);
-    do{
-      int ret,lokke;
-      
-      ret=sf_readf_float(ls->infile,val3,8192);
-      for(lokke=0;lokke<ret;lokke++)
-	*(l+r+lokke)=val3[ch+lokke*ls->sfinfo.channels];
-
-      sampsread=ret;
-
-      r+=sampsread;
-    }while(sampsread>0);
+  free(buf);
+}
+
+
+#ifdef _WIN32
+
+/* ly=destination, channels=samples per frame, size=values per channel in ly.
+   The file is decoded once, and the channels are deinterleaved into
+   ly, ly+size, ly+2*size, etc. */
+
+void readsound(struct LoadStruct *ls,mammut_float *ly, int channels, long size)
+{
+  readsound_serial(ls,ly,channels,size);
+}
+
+#else
+
+#include <pthread.h>
+
+/*
+  The file is decoded in a separate thread, which passes the blocks to
+  the loading thread through a ring of LOAD_NUMBLOCKS buffers. So the
+  decoding overlaps the deinterleaving and the first writes to the
+  spectrum, which are slow too, since every page of a new spectrum is
+  faulted in (or written to disk, if it is memory-mapped).
+
+  The fft can not start before the last block is in place, since every
+  value of the spectrum depends on every sample.
+*/
+
+#define LOAD_NUMBLOCKS 4
+
+struct ReadPipe{
+  struct LoadStruct *ls;
+  long size;
+  int blockframes;
+
+  float *bufs[LOAD_NUMBLOCKS];
+  int frames[LOAD_NUMBLOCKS];
+
+  int head;			/* Number of blocks decoded. */
+  int tail;			/* Number of blocks deinterleaved. */
+  bool done;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static void *readsound_decoder(void *arg){
+  struct ReadPipe *pipe=arg;
+  long r=0;
+
+  sf_seek(pipe->ls->infile,0,SEEK_SET);
+
+  while(r<pipe->size){
+    int slot=pipe->head%LOAD_NUMBLOCKS;
+    int ret;
+
+    pthread_mutex_lock(&pipe->lock);
+    while(pipe->head-pipe->tail==LOAD_NUMBLOCKS)
+      pthread_cond_wait(&pipe->cond,&pipe->lock);
+    pthread_mutex_unlock(&pipe->lock);
+
+    ret=sf_readf_float(pipe->ls->infile,pipe->bufs[slot],mammut_min(pipe->blockframes,pipe->size-r));
+    if(ret<=0)
+      break;
+
+    pthread_mutex_lock(&pipe->lock);
+    pipe->frames[slot]=ret;
+    pipe->head++;
+    pthread_cond_broadcast(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+
+    r+=ret;
+  }
+
+  pthread_mutex_lock(&pipe->lock);
+  pipe->done=true;
+  pthread_cond_broadcast(&pipe->cond);
+  pthread_mutex_unlock(&pipe->lock);
+
+  return NULL;
+}
+
+/* ly=destination, channels=samples per frame, size=values per channel in ly.
+   The file is decoded once, and the channels are deinterleaved into
+   ly, ly+size, ly+2*size, etc. */
+
+void readsound(struct LoadStruct *ls,mammut_float *ly, int channels, long size)
+{
+  struct ReadPipe pipe={0};
+  pthread_t thread;
+  int filechannels=ls->sfinfo.channels;
+  long r=0;
+  int i;
+
+  pipe.ls=ls;
+  pipe.size=size;
+  pipe.blockframes=readsound_blockframes();
+  pthread_mutex_init(&pipe.lock,NULL);
+  pthread_cond_init(&pipe.cond,NULL);
+  for(i=0;i<LOAD_NUMBLOCKS;i++)
+    pipe.bufs[i]=erroralloc(sizeof(float)*filechannels*pipe.blockframes);
+
+  if(pthread_create(&thread,NULL,readsound_decoder,&pipe)!=0){
+    fprintf(stderr,"Could not start decoding thread. Decoding in this thread instead.\n");
+    for(i=0;i<LOAD_NUMBLOCKS;i++)
+      free(pipe.bufs[i]);
+    readsound_serial(ls,ly,channels,size);
+    return;
   }
 
+  for(;;){
+    int slot;
+
+    pthread_mutex_lock(&pipe.lock);
+    while(pipe.tail==pipe.head && pipe.done==false)
+      pthread_cond_wait(&pipe.cond,&pipe.lock);
+    if(pipe.tail==pipe.head){
+      pthread_mutex_unlock(&pipe.lock);
+      break;
+    }
+    pthread_mutex_unlock(&pipe.lock);
+
+    slot=pipe.tail%LOAD_NUMBLOCKS;
+    readsound_deinterleave(ly,channels,size,r,pipe.bufs[slot],filechannels,pipe.frames[slot]);
+    r+=pipe.frames[slot];
+
+    pthread_mutex_lock(&pipe.lock);
+    pipe.tail++;
+    pthread_cond_broadcast(&pipe.cond);
+    pthread_mutex_unlock(&pipe.lock);
+  }
+
+  pthread_join(thread,NULL);
+
+  pthread_cond_destroy(&pipe.cond);
+  pthread_mutex_destroy(&pipe.lock);
+  for(i=0;i<LOAD_NUMBLOCKS;i++)
+    free(pipe.bufs[i]);
 }
 
+#endif
+
 
 
 static char *das_loadana(char *filename)
 {
-  int i,ch;
+  int i;
   SNDFILE *infile;
 
   SF_INFO *sfinfo=&loadstruct.sfinfo;
@@ -75,33 +231,33 @@ static char *das_loadana(char *filename)
   */
 
 
-  N=1;
-  while (N<framecnt)
-    N*=2;
+  N=fft_size(framecnt);
   for (i=0; i<dobler; i++)
     N*=2;
 
   duration = (float)framecnt/R;
   binfreq = (float)R/N;
-  if (lyd!=NULL) free(lyd);
+  SM_free(lyd);
   lyd=NULL;
+  DIRTY_all();
 
   //printf("N: %d, framecnt: %d, dobler: %d, samps_per_frame: %d, sfinfo->channels: %d, R: %d\n",N,framecnt,dobler,samps_per_frame,sfinfo->channels,R);
 
-  fvec(lyd, N*samps_per_frame);
+  lyd=SC_get(filename,sfinfo,N);
+
+  if(lyd!=NULL)
+    sf_close(infile);
+  else{
+    lyd=SM_alloc(N*samps_per_frame);
 
-  if (lyd2!=NULL) free(lyd2);
-  lyd2=NULL;
-  fvec(lyd2, N*samps_per_frame);
+    readsound(&loadstruct,lyd,samps_per_frame,N);
 
-  readsound(&loadstruct,lyd,samps_per_frame);
+    sf_close(infile);
 
-  sf_close(infile);
+    GUI_aboveprogressbar(0,1);
+    rfft_multi(lyd,  N/2,  samps_per_frame,  FORWARD);
 
-  for (ch=0; ch<samps_per_frame; ch++) {
-    printf("CH: %d/%d\n",ch,samps_per_frame);
-    GUI_aboveprogressbar(ch,samps_per_frame);
-    rfft(lyd+ch*N,  N/2,  FORWARD);
+    SC_put(filename,sfinfo,N,lyd);
   }
 
   strcpy(playfile, filename);
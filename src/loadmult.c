@@ -1,5 +1,8 @@
 
 #include "mammut.h"
+#include "spectrummem.h"
+#include "spectrumcache.h"
+#include "dirty.h"
 
 /* Default values must be set because the buttons arent made with glade. */
 bool loadandmultiply_convolve=true;
@@ -13,9 +16,10 @@ static char *das_load_and_multiply_ok(char *filename)
 {
 
   int i, N2, framecnt2, method=0, samps_per_frame2,ch;
-  float r1, r2, i1, i2, amp,phi;
+  mammut_float r1, r2, i1, i2, amp,phi;
   int progral;
   struct LoadStruct ls={0};
+  mammut_float *lyd2;
 
   SNDFILE *infile;
 
@@ -53,19 +57,22 @@ static char *das_load_and_multiply_ok(char *filename)
   }
   */
 
-  N2=1;
-  while (N2<framecnt2) N2*=2;
+  N2=fft_size(framecnt2);
   if (N2<N) N2=N;
-  if (lyd2!=NULL) free(lyd2);
-  lyd2=NULL;
-  fvec(lyd2, N2*samps_per_frame2);
+  lyd2=SC_get(filename,&ls.sfinfo,N2);
 
-  readsound(&ls, lyd2, samps_per_frame2);
-  sf_close(infile);
+  if(lyd2!=NULL)
+    sf_close(infile);
+  else{
+    lyd2=SM_alloc(N2*samps_per_frame2);
 
-  for (ch=0; ch<samps_per_frame; ch++) {
-    GUI_aboveprogressbar(ch,samps_per_frame);
-    rfft(lyd2+N2*ch,  N2/2,  FORWARD);
+    readsound(&ls, lyd2, samps_per_frame2, N2);
+    sf_close(infile);
+
+    GUI_aboveprogressbar(0,1);
+    rfft_multi(lyd2,  N2/2,  samps_per_frame2,  FORWARD);
+
+    SC_put(filename,&ls.sfinfo,N2,lyd2);
   }
 
   
@@ -104,11 +111,11 @@ static char *das_load_and_multiply_ok(char *filename)
   }
 
 
+  DIRTY_all();
+
   strcpy(playfile, filename);
 
-  free(lyd2);
-  lyd2=NULL;
-  fvec(lyd2, N*samps_per_frame);
+  SM_free(lyd2);
 
   return NULL;
 }
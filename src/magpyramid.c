@@ -0,0 +1,225 @@
+
+#include "mammut.h"
+
+#include "magpyramid.h"
+#include "threadpool.h"
+#include "dirty.h"
+
+
+/*
+  The spectrum is drawn as the largest magnitude of the bins under each
+  pixel column. Scanning every bin on each redraw is too slow for large
+  spectra, so the magnitudes are kept in a pyramid of min/max values,
+  made once per spectrum, with the blocks spread over the worker threads.
+
+  Level 0 has the min and max of each block of MP_BLOCK bins, and each
+  level above has blocks twice as large, until there is one block left.
+  MP_getRange uses the largest blocks inside the range, and reads the
+  bins at the edges from lyd, so a pixel column costs O(MP_BLOCK + log N)
+  no matter how many bins it covers.
+
+  The magnitude of bin i is sqrt(re*re+im*im) of lyd[2*i] and lyd[2*i+1]
+  (for bin 0, lyd[1] is the nyquist frequency, but it is drawn as if it
+  was the imaginary part, like before).
+
+  MP_spectrumChanged is called by DIRTY_end when lyd has changed. Only the
+  blocks over the dirty ranges are made again, unless the whole spectrum
+  is dirty. Then the pyramid is made again at the next call to MP_getRange.
+*/
+
+
+#define MP_BLOCK 64
+#define MP_MAXLEVELS 48
+
+
+struct MP_Level{
+  long num;			/* Blocks per channel. */
+  float *min;			/* min[ch*num+block] */
+  float *max;
+};
+
+static struct MP_Level levels[MP_MAXLEVELS];
+static int num_levels=0;
+static bool valid=false;
+static long mp_N=0;
+static int mp_channels=0;
+
+
+static void MP_free(void){
+  int l;
+
+  for(l=0;l<num_levels;l++){
+    free(levels[l].min);
+    free(levels[l].max);
+  }
+
+  num_levels=0;
+}
+
+static float MP_magnitude(int ch,long bin){
+  double real=lyd[ch*N+bin*2];
+  double imag=lyd[ch*N+bin*2+1];
+  return sqrt(real*real+imag*imag);
+}
+
+/* Makes the blocks [offset+start,offset+end) of a level. */
+struct MP_Job{
+  struct MP_Level *level;
+  long offset;
+};
+
+static void MP_makeLevel0(void *arg,long start,long end){
+  struct MP_Job *job=arg;
+  long num=levels[0].num;
+  long b;
+
+  for(b=job->offset+start;b<job->offset+end;b++){
+    int ch=b/num;
+    long bin=(b%num)*MP_BLOCK;
+    float min=MP_magnitude(ch,bin);
+    float max=min;
+    int i;
+
+    for(i=1;i<MP_BLOCK;i++){
+      float amp=MP_magnitude(ch,bin+i);
+      if(amp<min) min=amp;
+      if(amp>max) max=amp;
+    }
+
+    levels[0].min[b]=min;
+    levels[0].max[b]=max;
+  }
+}
+
+static void MP_makeLevel(void *arg,long start,long end){
+  struct MP_Job *job=arg;
+  struct MP_Level *level=job->level;
+  struct MP_Level *below=level-1;
+  long b;
+
+  for(b=job->offset+start;b<job->offset+end;b++){
+    int ch=b/level->num;
+    long b2=ch*below->num+(b%level->num)*2;
+
+    level->min[b]=below->min[b2];
+    level->max[b]=below->max[b2];
+
+    /* The last block of a level may have only one block below. */
+    if((b%level->num)*2+1<below->num){
+      level->min[b]=mammut_min(level->min[b],below->min[b2+1]);
+      level->max[b]=mammut_max(level->max[b],below->max[b2+1]);
+    }
+  }
+}
+
+static void MP_makeBlocks(struct MP_Level *level,long start,long end){
+  struct MP_Job job;
+
+  job.level=level;
+  job.offset=start;
+
+  if(level==&levels[0])
+    TP_run(MP_makeLevel0,&job,end-start);
+  else
+    TP_run(MP_makeLevel,&job,end-start);
+}
+
+static void MP_make(void){
+  long num=(N/2)/MP_BLOCK;
+
+  MP_free();
+
+  while(num>0 && num_levels<MP_MAXLEVELS){
+    struct MP_Level *level=&levels[num_levels];
+
+    level->num=num;
+    level->min=erroralloc(sizeof(float)*samps_per_frame*num);
+    level->max=erroralloc(sizeof(float)*samps_per_frame*num);
+
+    MP_makeBlocks(level,0,samps_per_frame*num);
+
+    num_levels++;
+    if(num==1)
+      break;
+    num=(num+1)/2;
+  }
+
+  mp_N=N;
+  mp_channels=samps_per_frame;
+  valid=true;
+}
+
+void MP_spectrumChanged(void){
+  int ch,i,l;
+
+  if(valid==false || DIRTY_isAll() || mp_N!=N || mp_channels!=samps_per_frame){
+    valid=false;
+    return;
+  }
+
+  for(ch=0;ch<samps_per_frame;ch++){
+    for(i=0;i<DIRTY_getNumRanges(ch);i++){
+      long start,end,b0,b1;
+
+      /* Values to blocks. */
+      DIRTY_getRange(ch,i,&start,&end);
+      b0=start/2/MP_BLOCK;
+      b1=mammut_min(((end+1)/2+MP_BLOCK-1)/MP_BLOCK,levels[0].num);
+
+      for(l=0;l<num_levels && b0<b1;l++){
+	MP_makeBlocks(&levels[l],ch*levels[l].num+b0,ch*levels[l].num+b1);
+	b0/=2;
+	b1=(b1+1)/2;
+      }
+    }
+  }
+}
+
+
+/* Finds the smallest and largest magnitude of the bins [start,end) of channel ch.
+   If the range is empty, *min is larger than *max. */
+void MP_getRange(int ch,long start,long end,float *min,float *max){
+  long b0,b1;
+  int l;
+
+  if(valid==false || mp_N!=N || mp_channels!=samps_per_frame)
+    MP_make();
+
+  *min=1e30f;
+  *max=-1.0f;
+
+  /* The bins which are not in a whole block. */
+  while(start<end && start%MP_BLOCK!=0){
+    float amp=MP_magnitude(ch,start++);
+    *min=mammut_min(*min,amp);
+    *max=mammut_max(*max,amp);
+  }
+  while(end>start && end%MP_BLOCK!=0){
+    float amp=MP_magnitude(ch,--end);
+    *min=mammut_min(*min,amp);
+    *max=mammut_max(*max,amp);
+  }
+
+  /* The blocks, from the bottom and up. */
+  b0=start/MP_BLOCK;
+  b1=end/MP_BLOCK;
+
+  for(l=0;b0<b1 && l<num_levels;l++){
+    struct MP_Level *level=&levels[l];
+    long offset=ch*level->num;
+
+    if(b0&1){
+      *min=mammut_min(*min,level->min[offset+b0]);
+      *max=mammut_max(*max,level->max[offset+b0]);
+      b0++;
+    }
+    if(b1&1){
+      b1--;
+      *min=mammut_min(*min,level->min[offset+b1]);
+      *max=mammut_max(*max,level->max[offset+b1]);
+    }
+
+    b0/=2;
+    b1/=2;
+  }
+}
@@ -0,0 +1,5 @@
+
+/* Min/max of the magnitudes of the spectrum over ranges of bins, for drawing. */
+
+extern LANGSPEC void MP_spectrumChanged(void);
+extern LANGSPEC void MP_getRange(int ch,long start,long end,float *min,float *max);
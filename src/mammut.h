@@ -24,6 +24,7 @@ extern LANGSPEC int theheight;
 #include "c_interface.h"
 
 #define mammut_min(a,b) (((a)<(b))?(a):(b))
+#define mammut_max(a,b) (((a)>(b))?(a):(b))
 
 
 /* Following code copied from Ceres. */
@@ -85,14 +86,23 @@ extern LANGSPEC int compression,  filefmt,  bits_per_samp,  samp_type;
 extern LANGSPEC int vers;
 extern LANGSPEC long framecnt, N;
 
-extern LANGSPEC float *lyd, *lyd2;
+/* The type of the spectrum. Compile with MAMMUT_DOUBLE defined (make DOUBLE=1)
+   to keep it in double precision, for very long analyses. */
+#ifdef MAMMUT_DOUBLE
+typedef double mammut_float;
+#else
+typedef float mammut_float;
+#endif
+
+extern LANGSPEC mammut_float *lyd;
 
 extern LANGSPEC float duration;		    /* Duration in secs */
 extern LANGSPEC int numchannels;	    /* Number of FFT channels */
 extern LANGSPEC float binfreq;		    /* Frequency pr. bin */
 extern LANGSPEC int R;
 
-extern LANGSPEC int playing, dobler, zoom, leftkc;
+extern LANGSPEC int playing, dobler;
+extern LANGSPEC double view_lowfreq, view_highfreq;
 extern LANGSPEC char playfile[200];
 
 extern LANGSPEC bool prefs_soundonoff;
@@ -100,23 +110,31 @@ extern LANGSPEC bool prefs_picture;
 extern LANGSPEC bool prefs_animation;
 extern LANGSPEC bool prefs_movingcamera;
 extern LANGSPEC bool prefs_loop;
+extern LANGSPEC bool prefs_spectrumondisk;
+extern LANGSPEC bool prefs_preresample;
+extern LANGSPEC bool prefs_preview;
 
 extern LANGSPEC bool isprocessing;
 
-extern LANGSPEC void rfft(float x[], int N, int forward);
-void bitreverse(float x[], int N);
+extern LANGSPEC void rfft(mammut_float x[], int N, int forward);
+extern LANGSPEC void rfft_multi(mammut_float x[], int N, int num, int forward);
+extern LANGSPEC void rfft_background(mammut_float x[], int N, int num, int forward);
+extern LANGSPEC long fft_size(long n);
+void bitreverse(mammut_float x[], int N);
 char *loadana(char *filename);
 
 void SaveWaveConsumer(
 		      void *outfile,
-		      float **samples,
+		      mammut_float **samples,
 		      int num_samples
 		      );
 
 void writesound(
+		mammut_float *sound,
+		float gain,
 		void (*WaveConsumer)(
 				void *pointer,
-				float **samples,
+				mammut_float **samples,
 				int num_samples
 				),
 		void *pointer
@@ -125,13 +143,13 @@ void writesound(
 void PlayStopHard(void);
 void Play(void);
 
-void readsound(struct LoadStruct *ls,float *ly, int spf);
+void readsound(struct LoadStruct *ls,mammut_float *ly, int spf, long size);
 
 
 char *SaveOk(char *filename);
 
-extern LANGSPEC float get_normalize_val(void);
-extern LANGSPEC void normalize(void);
+extern LANGSPEC float get_normalize_val(mammut_float *sound,long frames,int channels);
+extern LANGSPEC float get_save_gain(mammut_float *sound);
 
 
 #define int_progval() int progvalval=0;int *volatile progval=&progvalval
@@ -146,6 +164,10 @@ extern LANGSPEC void GUI_newprocess(void das_func(void));
 
 extern LANGSPEC void GUI_addUndo(void);
 extern LANGSPEC void RedrawWin(void);
+extern LANGSPEC void GUI_setView(double lowfreq,double highfreq);
+extern LANGSPEC bool GUI_isZoomed(void);
+extern LANGSPEC void GUI_lockSpectrum(void);
+extern LANGSPEC void GUI_unlockSpectrum(void);
 //#endif
 extern LANGSPEC void Transformit(void func(void));
 extern LANGSPEC void ReTransformit(void das_func(void));
@@ -154,8 +176,8 @@ extern LANGSPEC void printerror(const char *fmt, ...);
 extern LANGSPEC void *erroralloc(size_t size);
 
 #define fvec(name, size)\
-if ((name=(float *)erroralloc(size*sizeof(float)))==NULL) {\
-  fprintf(stderr,"Insufficient memory. Tried to allocate %d * %d bytes. Exiting.\n",(int)size,(int)sizeof(float)); \
+if ((name=(mammut_float *)erroralloc(size*sizeof(mammut_float)))==NULL) {\
+  fprintf(stderr,"Insufficient memory. Tried to allocate %d * %d bytes. Exiting.\n",(int)size,(int)sizeof(mammut_float)); \
   exit(-10);								\
  }
 
@@ -0,0 +1,435 @@
+
+#include "mammut.h"
+
+#include "render.h"
+#include "spectrummem.h"
+#include "threadpool.h"
+#include "dirty.h"
+
+#include <samplerate.h>
+
+#ifndef _WIN32
+#  include <pthread.h>
+#endif
+
+
+/*
+  Playing and saving need the sound, which is the inverse fft of lyd.
+  It is made in a separate buffer and kept, so that pressing play again,
+  or saving after playing, does not do the inverse fft again.
+
+  RC_spectrumChanged is called by DIRTY_end every time lyd is changed
+  (transforms, load, load and multiply, undo and redo). The channels of
+  the sound which the change has touched are marked as dirty, and only
+  those are transformed again by RC_getSound, together with the peak of
+  each channel, which the normalize gain is made from. If every channel
+  is dirty, the sound is freed, so that the memory is not used while the
+  sound is not valid. The sound must not be in use (playing) when
+  RC_spectrumChanged is called.
+
+  RC_getResampled returns the sound resampled to another samplerate, for
+  the "Resample before playing" pref. It is made once per spectrum and
+  samplerate, with the channels spread over the worker threads, so that
+  the player only needs to copy. Like the sound, the channels are
+  allocated by spectrummem, so that they count against the ram limit.
+
+  RC_getPreview is for listening to large spectra without waiting for the
+  full inverse fft. Only the lowest 1/factor of the bins are transformed,
+  which gives the sound at samplerate R/factor, with the same amplitude.
+  At the same time, the full sound is rendered from a copy of lyd in a
+  thread of its own (rfft_background), which the player picks up with
+  RC_getSoundIfReady when it is finished. RC_getSound waits for it
+  instead of starting another one. If the spectrum changes before the
+  thread is finished, the thread frees its sound itself.
+*/
+
+
+#define RC_BLOCKFRAMES 4096
+
+
+static unsigned long generation=1;
+
+static mammut_float *sound=NULL;
+static long sound_N=0;
+static int sound_channels=0;
+static bool *sound_dirty=NULL;	/* One for each channel. */
+static float *sound_gains=NULL;	/* The normalize gain of each channel. */
+static float normalize_val=1.0f;
+
+static float **resampled=NULL;
+static int resampled_channels=0;
+static long resampled_frames=0;
+static double resampled_rate=0.0;
+static unsigned long resampled_generation=0;
+
+static mammut_float *preview=NULL;
+static int preview_factor=0;
+static unsigned long preview_generation=0;
+
+/* Replaces the sound with mem (may be NULL), with every channel dirty. */
+static void RC_setSound(mammut_float *mem,long frames,int channels){
+  int ch;
+
+  SM_free(sound);
+  free(sound_dirty);
+  free(sound_gains);
+
+  sound=mem;
+  sound_N=frames;
+  sound_channels=channels;
+  sound_dirty=NULL;
+  sound_gains=NULL;
+
+  if(sound!=NULL){
+    sound_dirty=erroralloc(sizeof(bool)*channels);
+    sound_gains=erroralloc(sizeof(float)*channels);
+    for(ch=0;ch<channels;ch++)
+      sound_dirty[ch]=true;
+  }
+}
+
+/* The sound is normalized by the loudest channel. */
+static void RC_updateNormalizeVal(void){
+  int ch;
+
+  normalize_val=sound_gains[0];
+  for(ch=1;ch<sound_channels;ch++)
+    normalize_val=mammut_min(normalize_val,sound_gains[ch]);
+}
+
+#ifndef _WIN32
+
+struct RC_Render{
+  mammut_float *sound;
+  long N;
+  int channels;
+  float *gains;
+  bool done;
+  bool abandoned;		/* The spectrum has changed. The thread frees everything. */
+};
+
+/* The background render, from it is started until the sound is used. Protected by lock. */
+static struct RC_Render *render=NULL;
+
+static pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t render_done=PTHREAD_COND_INITIALIZER;
+
+
+static void *RC_renderThread(void *arg){
+  struct RC_Render *r=arg;
+
+  int ch;
+
+  rfft_background(r->sound,r->N/2,r->channels,INVERSE);
+  for(ch=0;ch<r->channels;ch++)
+    r->gains[ch]=get_normalize_val(r->sound+ch*r->N,r->N,1);
+
+  pthread_mutex_lock(&lock);
+  r->done=true;
+  if(r->abandoned){
+    SM_free(r->sound);
+    free(r->gains);
+    free(r);
+  }
+  pthread_cond_broadcast(&render_done);
+  pthread_mutex_unlock(&lock);
+
+  return NULL;
+}
+
+/* Makes the background render the sound, if it is finished. If wait is true, waits for it. */
+static void RC_takeRender(bool wait){
+  pthread_mutex_lock(&lock);
+
+  while(wait && render!=NULL && !render->done)
+    pthread_cond_wait(&render_done,&lock);
+
+  if(render!=NULL && render->done){
+    int ch;
+    RC_setSound(render->sound,render->N,render->channels);
+    for(ch=0;ch<sound_channels;ch++){
+      sound_dirty[ch]=false;
+      sound_gains[ch]=render->gains[ch];
+    }
+    RC_updateNormalizeVal();
+    free(render->gains);
+    free(render);
+    render=NULL;
+  }
+
+  pthread_mutex_unlock(&lock);
+}
+
+static void RC_startRender(void){
+  struct RC_Render *r;
+  pthread_t thread;
+
+  if(render!=NULL)
+    return;
+
+  r=erroralloc(sizeof(struct RC_Render));
+  r->sound=SM_alloc(samps_per_frame*N);
+  memcpy(r->sound,lyd,samps_per_frame*N*sizeof(mammut_float));
+  r->N=N;
+  r->channels=samps_per_frame;
+  r->gains=erroralloc(sizeof(float)*samps_per_frame);
+  r->done=false;
+  r->abandoned=false;
+
+  if(pthread_create(&thread,NULL,RC_renderThread,r)!=0){
+    SM_free(r->sound);
+    free(r->gains);
+    free(r);
+    return;
+  }
+  pthread_detach(thread);
+
+  render=r;
+}
+
+#endif
+
+
+static void RC_freeResampled(void){
+  int ch;
+
+  for(ch=0;ch<resampled_channels;ch++)
+    SM_free(resampled[ch]);
+  free(resampled);
+
+  resampled=NULL;
+  resampled_channels=0;
+}
+
+
+void RC_spectrumChanged(void){
+#ifndef _WIN32
+  pthread_mutex_lock(&lock);
+  if(render!=NULL){
+    if(render->done){
+      SM_free(render->sound);
+      free(render->gains);
+      free(render);
+    }else
+      render->abandoned=true;
+    render=NULL;
+  }
+  pthread_mutex_unlock(&lock);
+#endif
+
+  generation++;
+
+  if(sound!=NULL && sound_N==N && sound_channels==samps_per_frame && !DIRTY_isAll()){
+    int ch;
+    bool alldirty=true;
+    for(ch=0;ch<sound_channels;ch++){
+      if(DIRTY_getNumRanges(ch)>0)
+	sound_dirty[ch]=true;
+      if(sound_dirty[ch]==false)
+	alldirty=false;
+    }
+    if(alldirty)
+      RC_setSound(NULL,0,0);
+  }else
+    RC_setSound(NULL,0,0);
+
+  SM_free(preview);
+  preview=NULL;
+
+  RC_freeResampled();
+}
+
+static bool RC_soundIsValid(void){
+  int ch;
+
+  if(sound==NULL || sound_N!=N || sound_channels!=samps_per_frame)
+    return false;
+
+  for(ch=0;ch<sound_channels;ch++)
+    if(sound_dirty[ch])
+      return false;
+
+  return true;
+}
+
+/* Returns the sound of lyd, samps_per_frame channels of N frames.
+   Does the inverse fft only of the channels which have changed since the last time. */
+mammut_float *RC_getSound(void){
+  int ch,num_dirty=0;
+
+#ifndef _WIN32
+  RC_takeRender(true);
+#endif
+
+  if(RC_soundIsValid())
+    return sound;
+
+  if(sound==NULL || sound_N!=N || sound_channels!=samps_per_frame)
+    RC_setSound(SM_alloc(samps_per_frame*N),N,samps_per_frame);
+
+  for(ch=0;ch<sound_channels;ch++)
+    if(sound_dirty[ch])
+      num_dirty++;
+
+  GUI_aboveprogressbar(0,1);
+
+  if(num_dirty==sound_channels){
+    memcpy(sound,lyd,samps_per_frame*N*sizeof(mammut_float));
+    rfft_multi(sound,  N/2,  samps_per_frame,  INVERSE);
+  }else{
+    for(ch=0;ch<sound_channels;ch++)
+      if(sound_dirty[ch]){
+	memcpy(sound+ch*N,lyd+ch*N,N*sizeof(mammut_float));
+	rfft_multi(sound+ch*N,  N/2,  1,  INVERSE);
+      }
+  }
+
+  for(ch=0;ch<sound_channels;ch++)
+    if(sound_dirty[ch]){
+      sound_gains[ch]=get_normalize_val(sound+ch*N,N,1);
+      sound_dirty[ch]=false;
+    }
+
+  RC_updateNormalizeVal();
+
+  return sound;
+}
+
+/* Returns the sound if it is already made (or the background render has
+   finished), otherwise NULL. Never waits. */
+mammut_float *RC_getSoundIfReady(void){
+#ifndef _WIN32
+  RC_takeRender(false);
+#endif
+  return RC_soundIsValid() ? sound : NULL;
+}
+
+/* The gain which normalizes the sound returned by the last call to RC_getSound,
+   RC_getSoundIfReady or RC_getPreview. */
+float RC_getNormalizeVal(void){
+  return normalize_val;
+}
+
+/* Returns the sound of the lowest N/factor bins of lyd, samps_per_frame
+   channels of N/factor frames at samplerate R/factor, and starts rendering
+   the full sound in the background. Returns NULL if N is not divisible
+   by 2*factor, or if there are no threads to render in the background (windows). */
+mammut_float *RC_getPreview(int factor){
+#ifdef _WIN32
+  return NULL;
+#else
+  long M=N/factor;
+  int ch;
+
+  if(N%(2*factor)!=0)
+    return NULL;
+
+  if(preview==NULL || preview_generation!=generation || preview_factor!=factor){
+    SM_free(preview);
+
+    preview=SM_alloc(samps_per_frame*M);
+    for(ch=0;ch<samps_per_frame;ch++){
+      memcpy(preview+ch*M,lyd+ch*N,M*sizeof(mammut_float));
+      preview[ch*M+1]=0.0f;	/* The nyquist frequency of the preview is an ordinary bin of lyd. */
+    }
+
+    GUI_aboveprogressbar(0,1);
+    rfft_multi(preview,  M/2,  samps_per_frame,  INVERSE);
+
+    preview_generation=generation;
+    preview_factor=factor;
+  }
+
+  normalize_val=get_normalize_val(preview,M,samps_per_frame);
+
+  if(!RC_soundIsValid())
+    RC_startRender();
+
+  return preview;
+#endif
+}
+
+
+struct RC_ResampleJob{
+  double ratio;
+  int *progval;
+};
+
+static void RC_resampleChannels(void *arg,long start,long end){
+  struct RC_ResampleJob *job=arg;
+  float in[RC_BLOCKFRAMES];
+  long ch;
+
+  for(ch=start;ch<end;ch++){
+    mammut_float *src=sound+ch*N;
+    float *dst=resampled[ch];
+    long inpos=0,outpos=0;
+    int error;
+    SRC_STATE *state=src_new(SRC_SINC_BEST_QUALITY,1,&error);
+
+    while(state!=NULL && outpos<resampled_frames){
+      SRC_DATA data;
+      long num_in=mammut_min(RC_BLOCKFRAMES,N-inpos);
+      long i;
+
+      for(i=0;i<num_in;i++)
+	in[i]=src[inpos+i];
+
+      data.data_in=in;
+      data.data_out=dst+outpos;
+      data.input_frames=num_in;
+      data.output_frames=resampled_frames-outpos;
+      data.end_of_input=inpos+num_in>=N;
+      data.src_ratio=job->ratio;
+
+      if(src_process(state,&data)!=0 || (data.end_of_input && data.output_frames_gen==0))
+	break;
+
+      inpos+=data.input_frames_used;
+      outpos+=data.output_frames_gen;
+    }
+
+    if(state!=NULL)
+      src_delete(state);
+    else
+      printerror("Could not resample: %s",src_strerror(error));
+
+    __sync_fetch_and_add(job->progval,1);
+  }
+}
+
+/* Returns the sound of lyd resampled to samplerate, one float array of
+   *frames frames per channel. Made only if lyd or samplerate has changed. */
+float **RC_getResampled(double samplerate,long *frames){
+  struct RC_ResampleJob job;
+  int ch;
+  int_progval();
+
+  RC_getSound();
+
+  if(resampled!=NULL && resampled_generation==generation && resampled_rate==samplerate){
+    *frames=resampled_frames;
+    return resampled;
+  }
+
+  RC_freeResampled();
+
+  job.ratio=samplerate/R;
+  job.progval=progval;
+
+  resampled_channels=samps_per_frame;
+  resampled_frames=(long)ceil(N*job.ratio);
+  resampled=erroralloc(sizeof(float*)*resampled_channels);
+  for(ch=0;ch<resampled_channels;ch++)
+    resampled[ch]=SM_allocBytes(sizeof(float)*resampled_frames);
+
+  GUI_startprogressbar(0,progval,samps_per_frame);
+  TP_run(RC_resampleChannels,&job,samps_per_frame);
+  GUI_stopprogressbar();
+
+  resampled_rate=samplerate;
+  resampled_generation=generation;
+
+  *frames=resampled_frames;
+  return resampled;
+}
@@ -0,0 +1,9 @@
+
+/* The sound (inverse fft) of the spectrum, kept until the spectrum changes. */
+
+extern LANGSPEC void RC_spectrumChanged(void);
+extern LANGSPEC mammut_float *RC_getSound(void);
+extern LANGSPEC mammut_float *RC_getSoundIfReady(void);
+extern LANGSPEC mammut_float *RC_getPreview(int factor);
+extern LANGSPEC float RC_getNormalizeVal(void);
+extern LANGSPEC float **RC_getResampled(double samplerate,long *frames);
@@ -0,0 +1,127 @@
+
+#include "mammut.h"
+
+#include "ringbuffer.h"
+
+
+/*
+  The writer (the player's feeder thread) calls RB_writeSpace, RB_write and
+  RB_flush. The reader (the audio callback) calls RB_readSpace and RB_read.
+  Neither side ever waits for the other, takes a lock or allocates memory.
+
+  writepos and readpos count frames from the start and are never wrapped,
+  so the buffer is empty when they are equal and full when they are size
+  apart. Each is only changed by its own side. The frames are stored
+  interleaved at pos&(size-1).
+
+  RB_flush discards everything written so far. It does not touch readpos,
+  but tells the reader to skip to the current writepos the next time it
+  reads, so it can be called while the reader is running.
+*/
+
+
+struct RB_Ring{
+  float *buf;
+  int channels;
+  long size;			/* Frames. A power of two. */
+  volatile long writepos;
+  volatile long readpos;
+  volatile long flushpos;
+};
+
+
+struct RB_Ring *RB_new(int channels,long size){
+  struct RB_Ring *ring=erroralloc(sizeof(struct RB_Ring));
+  long realsize=1;
+
+  while(realsize<size)
+    realsize*=2;
+
+  ring->buf=erroralloc(sizeof(float)*channels*realsize);
+  ring->channels=channels;
+  ring->size=realsize;
+
+  return ring;
+}
+
+void RB_delete(struct RB_Ring *ring){
+  if(ring==NULL)
+    return;
+  free(ring->buf);
+  free(ring);
+}
+
+
+long RB_writeSpace(struct RB_Ring *ring){
+  return ring->size-(ring->writepos-ring->readpos);
+}
+
+/* data[ch] holds frames frames for each channel. There must be room for them (RB_writeSpace). */
+void RB_write(struct RB_Ring *ring,float **data,long frames){
+  long pos=ring->writepos;
+  long i;
+  int ch;
+
+  for(i=0;i<frames;i++){
+    float *frame=ring->buf+((pos+i)&(ring->size-1))*ring->channels;
+    for(ch=0;ch<ring->channels;ch++)
+      frame[ch]=data[ch][i];
+  }
+
+  /* The frames must be in the buffer before the reader can see them. */
+  __sync_synchronize();
+  ring->writepos=pos+frames;
+}
+
+void RB_flush(struct RB_Ring *ring){
+  __sync_synchronize();
+  ring->flushpos=ring->writepos;
+}
+
+
+static void RB_skipFlushed(struct RB_Ring *ring){
+  long flushpos=ring->flushpos;
+  if(ring->readpos<flushpos){
+    ring->readpos=flushpos;
+    __sync_synchronize();
+  }
+}
+
+long RB_readSpace(struct RB_Ring *ring){
+  RB_skipFlushed(ring);
+  __sync_synchronize();
+  return ring->writepos-ring->readpos;
+}
+
+/* Reads up to frames frames into the first channels channels of data, and
+   returns how many were read. That is normally what RB_readSpace returned,
+   but can be fewer if RB_flush was called in between. Channels which are
+   not in the ring are not touched. */
+long RB_read(struct RB_Ring *ring,float **data,int channels,long frames){
+  long pos;
+  long i;
+  int ch;
+
+  RB_skipFlushed(ring);
+  pos=ring->readpos;
+
+  if(channels>ring->channels)
+    channels=ring->channels;
+
+  __sync_synchronize();
+
+  if(frames>ring->writepos-pos)
+    frames=ring->writepos-pos;
+
+  for(i=0;i<frames;i++){
+    float *frame=ring->buf+((pos+i)&(ring->size-1))*ring->channels;
+    for(ch=0;ch<channels;ch++)
+      data[ch][i]=frame[ch];
+  }
+
+  /* Reading must be finished before the writer can use the frames again. */
+  __sync_synchronize();
+  ring->readpos=pos+frames;
+
+  return frames;
+}
@@ -0,0 +1,12 @@
+
+/* Lock-free ring buffer of sound, for one writer thread and one reader thread. */
+
+struct RB_Ring;
+
+extern LANGSPEC struct RB_Ring *RB_new(int channels,long size);
+extern LANGSPEC void RB_delete(struct RB_Ring *ring);
+extern LANGSPEC long RB_writeSpace(struct RB_Ring *ring);
+extern LANGSPEC void RB_write(struct RB_Ring *ring,float **data,long frames);
+extern LANGSPEC void RB_flush(struct RB_Ring *ring);
+extern LANGSPEC long RB_readSpace(struct RB_Ring *ring);
+extern LANGSPEC long RB_read(struct RB_Ring *ring,float **data,int channels,long frames);
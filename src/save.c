@@ -1,5 +1,6 @@
 
 #include "mammut.h"
+#include "render.h"
 
 #include <stdint.h>
 
@@ -20,7 +21,7 @@ extern struct LoadStruct loadstruct;
 
 void SaveWaveConsumer(
 		      void *outfile,
-		      float **samples,
+		      mammut_float **samples,
 		      int num_samples
 		      )
 {
@@ -45,15 +46,16 @@ void SaveWaveConsumer(
 
 
 
-float get_normalize_val(void)
+float get_normalize_val(mammut_float *sound,long frames,int channels)
 {
-  int i, ch;
-  float max, samp;
-  float *l;
+  long i;
+  int ch;
+  mammut_float max, samp;
+  mammut_float *l;
   max=-1e+10;
-  for (ch=0; ch<samps_per_frame; ch++) {
-    l=lyd+ch*N;
-    for (i=0; i<N; i++) {
+  for (ch=0; ch<channels; ch++) {
+    l=sound+ch*frames;
+    for (i=0; i<frames; i++) {
       samp=*(l+i);
       if (samp>max) max=samp;
       if (-samp>max) max=-samp;
@@ -62,56 +64,50 @@ float get_normalize_val(void)
   return max=0.9/max;
 }
 
-void normalize(){
-  int i, ch;
-  float *l;
-  float max=get_normalize_val();
-  for (ch=0; ch<samps_per_frame; ch++) {
-    l=lyd+ch*N;
-    for (i=0; i<N; i++) *(l+i)*=max;
-  }
-
-#if 0
-  else if (max>0.99) {
-    fprintf(stderr,"Can\'t save properly. Try to check the \"Normalize gain\" box.\n");
-    return false;
-  }
-  return true;
-#endif
-
+/* The gain writesound should use for a sound which is not the one from
+   RC_getSound, since that one has its gain already (RC_getNormalizeVal). */
+float get_save_gain(mammut_float *sound){
+  return synthandsave_normalize_gain ? get_normalize_val(sound,N,samps_per_frame) : 1.0f;
 }
 
-
-
-
+/* The sound is not changed. Unless gain is 1, it is applied to a copy
+   of each block before it is given to WaveConsumer. */
 void writesound(
+		mammut_float *sound,
+		float gain,
 		void (*WaveConsumer)(
 				void *pointer,
-				float **samples,
+				mammut_float **samples,
 				int num_samples
 				),
 		void *pointer
 		)
 {
-  int i, ch;
-  float *l=lyd;
+  int i, j, ch;
+  mammut_float *l=sound;
 
-  static float **ly;
+  static mammut_float **ly;
+  static mammut_float *gainbuf;
   static int lysize=0;
   if(lysize<samps_per_frame){
     lysize=samps_per_frame;
     free(ly);
-    ly=erroralloc(sizeof(float*)*lysize);
+    free(gainbuf);
+    ly=erroralloc(sizeof(mammut_float*)*lysize);
+    gainbuf=erroralloc(sizeof(mammut_float)*1024*lysize);
   }
 
-  if(synthandsave_normalize_gain)
-    normalize();
-
   for(i=0;i<N;i+=1024){
+    int num=mammut_min(N-i,1024);
     for(ch=0;ch<samps_per_frame;ch++){
       ly[ch]=l+i+(ch*N);
+      if(gain!=1.0f){
+	for(j=0;j<num;j++)
+	  gainbuf[ch*1024+j]=ly[ch][j]*gain;
+	ly[ch]=gainbuf+ch*1024;
+      }
     }
-    (*WaveConsumer)(pointer,ly,mammut_min(N-i,1024));
+    (*WaveConsumer)(pointer,ly,num);
   }
 
 }
@@ -122,7 +118,7 @@ void writesound(
 static char *das_SaveOk(char *filename)
 {
 
-  long i,ch;
+  mammut_float *sound;
 
   /*
   out_AFsetup=afNewFileSetup();
@@ -166,19 +162,14 @@ static char *das_SaveOk(char *filename)
     fprintf(stderr,"Can\'t open file.\n");
     return "Can\'t open file";
   }
-  for (i=0; i<samps_per_frame*N; i++) lyd2[i]=lyd[i];
-
-  for (ch=0; ch<samps_per_frame; ch++) {
-    GUI_aboveprogressbar(ch,samps_per_frame);
-    rfft(lyd+ch*N,  N/2,  INVERSE);
-  }
+  sound=RC_getSound();
 
-  writesound(SaveWaveConsumer,outfile);
+  // The gain was found when the sound was rendered.
+  writesound(sound,synthandsave_normalize_gain ? RC_getNormalizeVal() : 1.0f,SaveWaveConsumer,outfile);
   
   //  afCloseFile(outfile);
   sf_close(outfile);
 
-  for (i=0; i<samps_per_frame*N; i++) lyd[i]=lyd2[i];
   strcpy(playfile, filename);
 
   free(sfinfo_write);
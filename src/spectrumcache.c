@@ -0,0 +1,356 @@
+
+#include "mammut.h"
+
+#include "spectrumcache.h"
+#include "spectrummem.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+#ifndef _WIN32
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <dirent.h>
+#  include <utime.h>
+#  include <sys/stat.h>
+#endif
+
+
+/*
+  After a sound file has been analysed, the spectrum is written to
+  <cachedir>/<hash>.mammutspec. When the same file is loaded again with
+  the same analysis size, the spectrum is memory-mapped from that file
+  instead (privately, so that the transforms do not change the cache),
+  and neither the decoding nor the fft is needed. If it does not fit in
+  ram, it is read into a spectrum file instead (SM_mapFile).
+
+  The file starts with a SC_HEADERSIZE bytes text header which holds
+  the key: the full path, size and modification time of the sound file,
+  its format, channels, samplerate and number of frames, the size of
+  the analysis (which includes the duration doubling) and the precision
+  of the spectrum. The spectrum follows, channel after channel, exactly
+  as in lyd. The hash in the file name is only used to find the file;
+  the whole key in the header must match.
+
+  The cache directory is MAMMUT_CACHEDIR, or $XDG_CACHE_HOME/mammut, or
+  ~/.cache/mammut. When the cache grows larger than MAMMUT_CACHESIZE
+  megabytes (default SC_DEFAULTSIZE), the least recently used files
+  are deleted. MAMMUT_CACHESIZE=0 turns the cache off.
+
+  Cache files are written to .<name>.tmp-XXXXXX first and then renamed
+  (SC_openTemp, SC_closeTemp), so that a cache file is never half written.
+  Temporary files left behind by a mammut which crashed or was killed
+  count in the size, and are deleted when they are SC_TEMPAGE seconds old.
+
+  The decoded background pictures (PictureHolder.cpp, *.pixels) are cached
+  in the same directory, and count in its size and are trimmed like the
+  spectra.
+
+  Under windows, there is no cache.
+*/
+
+
+#define SC_HEADERSIZE 4096
+#define SC_DEFAULTSIZE 20480
+#define SC_WRITECHUNK (8*1024*1024)
+#define SC_TEMPAGE 600
+
+/* Room for the cache directory and a file name in it. */
+#define SC_NAMELEN (PATH_MAX+64)
+
+
+#ifdef _WIN32
+
+mammut_float *SC_get(const char *filename,SF_INFO *sfinfo,long size){
+  return NULL;
+}
+
+void SC_put(const char *filename,SF_INFO *sfinfo,long size,mammut_float *spectrum){
+}
+
+bool SC_getDir(char *dir,int len){
+  return false;
+}
+
+int SC_openTemp(const char *cachename,char *tempname,int len){
+  return -1;
+}
+
+bool SC_closeTemp(int fd,const char *tempname,const char *cachename,bool ok){
+  return false;
+}
+
+#else
+
+
+static long long SC_getMaxSize(void){
+  char *env=getenv("MAMMUT_CACHESIZE");
+
+  if(env!=NULL)
+    return atoll(env)*1024*1024;
+
+  return (long long)SC_DEFAULTSIZE*1024*1024;
+}
+
+/* Makes the directory and its parent, if necessary. */
+static bool SC_makeDir(const char *dir){
+  char parent[PATH_MAX];
+  char *slash;
+
+  if(snprintf(parent,sizeof(parent),"%s",dir)>=(int)sizeof(parent))
+    return false;
+  slash=strrchr(parent,'/');
+  if(slash!=NULL && slash!=parent){
+    *slash=0;
+    mkdir(parent,0755);
+  }
+
+  return mkdir(dir,0755)==0 || errno==EEXIST;
+}
+
+/* Finds the cache directory, and makes it if necessary. Returns false if there is none, or if the name is longer than len. */
+bool SC_getDir(char *dir,int len){
+  char *env=getenv("MAMMUT_CACHEDIR");
+  int ret;
+
+  if(env!=NULL)
+    ret=snprintf(dir,len,"%s",env);
+  else if(getenv("XDG_CACHE_HOME")!=NULL)
+    ret=snprintf(dir,len,"%s/mammut",getenv("XDG_CACHE_HOME"));
+  else if(getenv("HOME")!=NULL)
+    ret=snprintf(dir,len,"%s/.cache/mammut",getenv("HOME"));
+  else
+    return false;
+
+  if(ret>=len)
+    return false;
+
+  return SC_makeDir(dir);
+}
+
+/* Makes the header, and the name of the cache file. Returns false if the sound file can not be found,
+   or if the key or the name does not fit. A cut key could match another file. */
+static bool SC_getKey(const char *filename,SF_INFO *sfinfo,long size,char *key,char *cachename,int len){
+  char dir[PATH_MAX];
+  char path[PATH_MAX];
+  struct stat st;
+  unsigned long long hash=14695981039346656037ULL;
+  int i;
+
+  if(SC_getMaxSize()<=0)
+    return false;
+
+  if(realpath(filename,path)==NULL || stat(path,&st)!=0)
+    return false;
+
+  if(SC_getDir(dir,sizeof(dir))==false)
+    return false;
+
+  memset(key,0,SC_HEADERSIZE);
+  if(snprintf(key,SC_HEADERSIZE,
+	   "mammutspec 1\n"
+	   "path=%s\n"
+	   "filesize=%lld\n"
+	   "mtime=%lld.%09ld\n"
+	   "format=%x\n"
+	   "channels=%d\n"
+	   "samplerate=%d\n"
+	   "frames=%lld\n"
+	   "size=%ld\n"
+	   "precision=%d\n",
+	   path,
+	   (long long)st.st_size,
+	   (long long)st.st_mtim.tv_sec,(long)st.st_mtim.tv_nsec,
+	   sfinfo->format,
+	   sfinfo->channels,
+	   sfinfo->samplerate,
+	   (long long)sfinfo->MSF_FRAMENAME,
+	   size,
+	   (int)sizeof(mammut_float)
+	   )>=SC_HEADERSIZE)
+    return false;
+
+  for(i=0;key[i]!=0;i++){
+    hash^=(unsigned char)key[i];
+    hash*=1099511628211ULL;
+  }
+
+  return snprintf(cachename,len,"%s/%016llx.mammutspec",dir,hash)<len;
+}
+
+static bool SC_isCacheFile(const char *name){
+  int len=strlen(name);
+
+  return (len>=11 && !strcmp(name+len-11,".mammutspec"))
+    || (len>=7 && !strcmp(name+len-7,".pixels"));
+}
+
+static bool SC_isTempFile(const char *name){
+  return name[0]=='.' && strstr(name,".tmp-")!=NULL;
+}
+
+/* Creates a temporary file in the directory of cachename, to be renamed
+   to cachename by SC_closeTemp. Returns the file descriptor, or -1. */
+int SC_openTemp(const char *cachename,char *tempname,int len){
+  const char *slash=strrchr(cachename,'/');
+
+  if(slash==NULL)
+    return -1;
+
+  if(snprintf(tempname,len,"%.*s/.%s.tmp-XXXXXX",(int)(slash-cachename),cachename,slash+1)>=len)
+    return -1;
+
+  return mkstemp(tempname);
+}
+
+/* Closes the file from SC_openTemp, and renames it to cachename if ok is true.
+   Otherwise, or if that fails, the file is deleted. Returns true if it was renamed. */
+bool SC_closeTemp(int fd,const char *tempname,const char *cachename,bool ok){
+  if(close(fd)!=0)
+    ok=false;
+
+  if(ok==false || rename(tempname,cachename)!=0){
+    unlink(tempname);
+    return false;
+  }
+
+  return true;
+}
+
+/* Deletes the least recently used files until the cache is small enough to hold newsize more bytes. */
+static void SC_trim(const char *dir,long long newsize){
+  long long maxsize=SC_getMaxSize();
+
+  for(;;){
+    DIR *d=opendir(dir);
+    struct dirent *entry;
+    char name[SC_NAMELEN],oldest[SC_NAMELEN]={0};
+    time_t oldesttime=0;
+    long long total=newsize;
+
+    if(d==NULL)
+      return;
+
+    while((entry=readdir(d))!=NULL){
+      struct stat st;
+      bool temp=SC_isTempFile(entry->d_name);
+
+      if(temp==false && SC_isCacheFile(entry->d_name)==false)
+	continue;
+
+      if(snprintf(name,sizeof(name),"%s/%s",dir,entry->d_name)>=(int)sizeof(name) || stat(name,&st)!=0)
+	continue;
+
+      if(temp==true && st.st_mtime<time(NULL)-SC_TEMPAGE){
+	fprintf(stderr,"Removing %s, left behind in the spectrum cache.\n",name);
+	unlink(name);
+	continue;
+      }
+
+      total+=st.st_size;
+
+      /* Still being written. */
+      if(temp==true)
+	continue;
+
+      if(oldest[0]==0 || st.st_mtime<oldesttime){
+	strcpy(oldest,name);
+	oldesttime=st.st_mtime;
+      }
+    }
+
+    closedir(d);
+
+    if(total<=maxsize || oldest[0]==0)
+      return;
+
+    fprintf(stderr,"Removing %s from the spectrum cache.\n",oldest);
+    unlink(oldest);
+  }
+}
+
+
+/* Returns the cached spectrum of the file, analysed with size values per
+   channel, or NULL if it is not in the cache. Free it with SM_free. */
+mammut_float *SC_get(const char *filename,SF_INFO *sfinfo,long size){
+  char key[SC_HEADERSIZE];
+  char header[SC_HEADERSIZE];
+  char cachename[SC_NAMELEN];
+  long num=size*sfinfo->channels;
+  mammut_float *ret;
+  struct stat st;
+  int fd;
+
+  if(SC_getKey(filename,sfinfo,size,key,cachename,sizeof(cachename))==false)
+    return NULL;
+
+  fd=open(cachename,O_RDONLY);
+  if(fd==-1)
+    return NULL;
+
+  if(fstat(fd,&st)!=0
+     || st.st_size!=SC_HEADERSIZE+num*(long long)sizeof(mammut_float)
+     || read(fd,header,SC_HEADERSIZE)!=SC_HEADERSIZE
+     || memcmp(header,key,SC_HEADERSIZE)
+     )
+    {
+      close(fd);
+      return NULL;
+    }
+
+  ret=SM_mapFile(fd,SC_HEADERSIZE,num);
+  close(fd);
+
+  if(ret!=NULL){
+    utime(cachename,NULL);
+    printf("Spectrum of %s loaded from %s.\n",filename,cachename);
+  }
+
+  return ret;
+}
+
+/* Writes the spectrum to the cache. */
+void SC_put(const char *filename,SF_INFO *sfinfo,long size,mammut_float *spectrum){
+  char key[SC_HEADERSIZE];
+  char cachename[SC_NAMELEN];
+  char tempname[SC_NAMELEN+16];
+  char *slash;
+  size_t bytes=size*sfinfo->channels*sizeof(mammut_float);
+  size_t pos;
+  bool ok;
+  int fd;
+
+  int_progval();
+
+  if(SC_getKey(filename,sfinfo,size,key,cachename,sizeof(cachename))==false)
+    return;
+
+  if(SC_HEADERSIZE+bytes>SC_getMaxSize())
+    return;
+
+  slash=strrchr(cachename,'/');
+  *slash=0;
+  SC_trim(cachename,SC_HEADERSIZE+bytes);
+  *slash='/';
+
+  fd=SC_openTemp(cachename,tempname,sizeof(tempname));
+  if(fd==-1)
+    return;
+
+  ok=write(fd,key,SC_HEADERSIZE)==SC_HEADERSIZE;
+
+  /* A big spectrum takes a while to write, so the progressbar counts the chunks. */
+  GUI_startprogressbar(0,progval,(int)((bytes+SC_WRITECHUNK-1)/SC_WRITECHUNK));
+  for(pos=0;ok && pos<bytes;pos+=SC_WRITECHUNK){
+    size_t len=mammut_min((size_t)SC_WRITECHUNK,bytes-pos);
+    ok=write(fd,(char*)spectrum+pos,len)==(ssize_t)len;
+    *progval=(int)(pos/SC_WRITECHUNK)+1;
+  }
+  GUI_stopprogressbar();
+
+  if(SC_closeTemp(fd,tempname,cachename,ok)==false)
+    fprintf(stderr,"Could not write %s to the spectrum cache. Is the disk full?\n",cachename);
+}
+
+#endif
@@ -0,0 +1,9 @@
+
+/* Cache of analysed sound files (*.mammutspec), so that loading the same
+   file again does not need to decode it and do the fft. */
+
+extern LANGSPEC mammut_float *SC_get(const char *filename,SF_INFO *sfinfo,long size);
+extern LANGSPEC void SC_put(const char *filename,SF_INFO *sfinfo,long size,mammut_float *spectrum);
+extern LANGSPEC bool SC_getDir(char *dir,int len);
+extern LANGSPEC int SC_openTemp(const char *cachename,char *tempname,int len);
+extern LANGSPEC bool SC_closeTemp(int fd,const char *tempname,const char *cachename,bool ok);
@@ -0,0 +1,330 @@
+
+#include "mammut.h"
+
+#include "spectrummem.h"
+
+#ifndef _WIN32
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <pthread.h>
+#endif
+
+#ifndef TEMPDIR
+#  define TEMPDIR "/tmp"
+#endif
+
+
+/*
+  The spectrum is normally kept in ram. When the spectra would take more
+  than half of the physical memory (or MAMMUT_MAXRAM megabytes, if set),
+  or when the "Spectrum on Disk" pref is set, a spectrum is instead put
+  in a file in TEMPDIR, which is memory-mapped. The file is unlinked
+  right away, so it disappears when it is unmapped or mammut exits.
+
+  Everything else just sees an ordinary array. The kernel writes the pages
+  back to the file when ram is needed, so the memory use is bounded. The
+  fft (fft.c) uses larger tiles for mapped spectra, so that it reads and
+  writes whole pages.
+
+  Spectra in ram are allocated with mmap too, aligned to SM_HUGEPAGESIZE
+  and marked with MADV_HUGEPAGE, so that transparent huge pages are used.
+  This removes most of the TLB misses in the transforms which jump around
+  in the spectrum (bitreverse, block swap). MAMMUT_HUGEPAGES=explicit
+  first tries the reserved huge pages (MAP_HUGETLB, see
+  /proc/sys/vm/nr_hugepages), and MAMMUT_HUGEPAGES=0 uses plain malloc.
+
+  Under windows, the spectrum is always in ram, and malloc is used.
+
+  The list of spectra is protected by a lock, since the full sound is
+  rendered in the background while a preview is playing (render.c).
+*/
+
+
+#define SM_HUGEPAGESIZE (2*1024*1024)
+
+
+struct SM_Mem{
+  struct SM_Mem *next;
+  mammut_float *mem;
+  size_t size;
+  bool ondisk;
+  bool mapped;			/* Freed with munmap instead of free. */
+};
+
+static struct SM_Mem *mems=NULL;
+static size_t inram=0;
+
+#ifndef _WIN32
+static pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+#  define SM_LOCK() pthread_mutex_lock(&lock)
+#  define SM_UNLOCK() pthread_mutex_unlock(&lock)
+#else
+#  define SM_LOCK()
+#  define SM_UNLOCK()
+#endif
+
+
+static size_t SM_getRamLimit(void){
+  char *env=getenv("MAMMUT_MAXRAM");
+
+  if(env!=NULL)
+    return (size_t)atol(env)*1024*1024;
+
+#ifdef _WIN32
+  return (size_t)-1;
+#else
+  return (size_t)sysconf(_SC_PHYS_PAGES)/2*sysconf(_SC_PAGESIZE);
+#endif
+}
+
+
+#ifndef _WIN32
+
+/* Called with the lock held, often from a worker thread, so errors only go to stderr. */
+static mammut_float *SM_map(size_t size){
+  char name[1024];
+  void *mem;
+  int fd;
+
+  snprintf(name,1000,"%s/mammut_spectrum-XXXXXX",TEMPDIR);
+
+  fd=mkstemp(name);
+  if(fd==-1){
+    fprintf(stderr,"Could not create spectrum file %s.\n",name);
+    return NULL;
+  }
+  unlink(name);
+
+  if(ftruncate(fd,size)!=0){
+    fprintf(stderr,"Could not make spectrum file %s %ld bytes big. Is the disk full?\n",name,(long)size);
+    close(fd);
+    return NULL;
+  }
+
+  mem=mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+  close(fd);
+
+  if(mem==MAP_FAILED){
+    fprintf(stderr,"Could not memory-map spectrum file %s.\n",name);
+    return NULL;
+  }
+
+#ifdef MADV_HUGEPAGE
+  /* Only has an effect if TEMPDIR is a tmpfs with huge=advise. */
+  madvise(mem,size,MADV_HUGEPAGE);
+#endif
+
+  printf("Spectrum of %ld MB is memory-mapped from %s.\n",(long)(size/(1024*1024)),TEMPDIR);
+
+  return mem;
+}
+
+/* Anonymous (zeroed) memory, aligned for huge pages. size must be a multiple of SM_HUGEPAGESIZE. */
+static mammut_float *SM_mapHuge(size_t size){
+  char *env=getenv("MAMMUT_HUGEPAGES");
+  char *mem;
+  size_t head;
+
+  if(env!=NULL && !strcmp(env,"0"))
+    return NULL;
+
+#ifdef MAP_HUGETLB
+  if(env!=NULL && !strcmp(env,"explicit")){
+    mem=mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+    if(mem!=MAP_FAILED)
+      return (mammut_float*)mem;
+  }
+#endif
+
+  /* Map one huge page more than needed, and unmap what is outside the aligned part. */
+  mem=mmap(NULL,size+SM_HUGEPAGESIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+  if(mem==MAP_FAILED)
+    return NULL;
+
+  head=(SM_HUGEPAGESIZE-(size_t)mem%SM_HUGEPAGESIZE)%SM_HUGEPAGESIZE;
+  if(head>0)
+    munmap(mem,head);
+  munmap(mem+head+size,SM_HUGEPAGESIZE-head);
+  mem+=head;
+
+#ifdef MADV_HUGEPAGE
+  madvise(mem,size,MADV_HUGEPAGE);
+#endif
+
+  return (mammut_float*)mem;
+}
+
+#endif
+
+
+/* Returns size zeroed bytes. Exits if there is no memory, like fvec. */
+void *SM_allocBytes(size_t size){
+  struct SM_Mem *sm=erroralloc(sizeof(struct SM_Mem));
+
+  sm->size=size;
+  sm->mem=NULL;
+  sm->ondisk=false;
+  sm->mapped=false;
+
+  SM_LOCK();
+
+#ifndef _WIN32
+  if(prefs_spectrumondisk==true || inram+size>SM_getRamLimit()){
+    sm->mem=SM_map(size);
+    sm->ondisk=sm->mapped=sm->mem!=NULL;
+  }
+
+  if(sm->mem==NULL && size>=SM_HUGEPAGESIZE){
+    size_t hugesize=(size+SM_HUGEPAGESIZE-1)/SM_HUGEPAGESIZE*SM_HUGEPAGESIZE;
+    sm->mem=SM_mapHuge(hugesize);
+    if(sm->mem!=NULL){
+      sm->size=hugesize;
+      sm->mapped=true;
+      inram+=hugesize;
+    }
+  }
+#endif
+
+  if(sm->mem==NULL){
+    sm->mem=erroralloc(size);
+    if(sm->mem==NULL){
+      fprintf(stderr,"Insufficient memory. Tried to allocate %ld bytes. Exiting.\n",(long)size);
+      exit(-10);
+    }
+    inram+=size;
+  }
+
+  sm->next=mems;
+  mems=sm;
+
+  SM_UNLOCK();
+
+  return sm->mem;
+}
+
+/* Returns num zeroed floats. */
+mammut_float *SM_alloc(long num){
+  return SM_allocBytes(num*sizeof(mammut_float));
+}
+
+#ifndef _WIN32
+
+/* Reads num values at offset in the file fd into a new spectrum. */
+static mammut_float *SM_readFile(int fd,long offset,long num){
+  mammut_float *mem=SM_alloc(num);
+  size_t size=num*sizeof(mammut_float);
+  size_t pos=0;
+
+  while(pos<size){
+    ssize_t len=pread(fd,(char*)mem+pos,mammut_min(size-pos,(size_t)(8*1024*1024)),offset+pos);
+    if(len<=0){
+      SM_free(mem);
+      return NULL;
+    }
+    pos+=len;
+  }
+
+  return mem;
+}
+
+#endif
+
+/* Returns num values at offset (a multiple of the page size) in the file fd,
+   as a spectrum which can be changed without changing the file.
+
+   The file is mapped privately, so only the pages which are changed take
+   ram. But those can be all of them, so the mapping is counted as ram like
+   any other spectrum in ram. If it does not fit in ram (or the "Spectrum on
+   Disk" pref is set), the values are read into a spectrum from SM_alloc
+   instead, which is then a spectrum file in TEMPDIR.
+
+   Returns NULL if the file could not be mapped or read. */
+mammut_float *SM_mapFile(int fd,long offset,long num){
+#ifdef _WIN32
+  return NULL;
+#else
+  struct SM_Mem *sm;
+  size_t size=num*sizeof(mammut_float);
+  void *mem;
+
+  SM_LOCK();
+  if(prefs_spectrumondisk==true || inram+size>SM_getRamLimit()){
+    SM_UNLOCK();
+    return SM_readFile(fd,offset,num);
+  }
+  SM_UNLOCK();
+
+  mem=mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,offset);
+  if(mem==MAP_FAILED)
+    return NULL;
+
+  sm=erroralloc(sizeof(struct SM_Mem));
+  sm->mem=mem;
+  sm->size=size;
+  sm->ondisk=false;
+  sm->mapped=true;
+
+  SM_LOCK();
+  inram+=size;
+  sm->next=mems;
+  mems=sm;
+  SM_UNLOCK();
+
+  return sm->mem;
+#endif
+}
+
+void SM_free(void *mem){
+  struct SM_Mem *sm;
+  struct SM_Mem *prev=NULL;
+
+  if(mem==NULL)
+    return;
+
+  SM_LOCK();
+  sm=mems;
+
+  while(sm!=NULL){
+    if(sm->mem==mem){
+      if(prev==NULL)
+	mems=sm->next;
+      else
+	prev->next=sm->next;
+
+      if(sm->ondisk==false)
+	inram-=sm->size;
+
+#ifndef _WIN32
+      if(sm->mapped)
+	munmap(sm->mem,sm->size);
+      else
+#endif
+	free(sm->mem);
+
+      free(sm);
+      SM_UNLOCK();
+      return;
+    }
+    prev=sm;
+    sm=sm->next;
+  }
+
+  SM_UNLOCK();
+
+  printerror("Error in file spectrummem.c function SM_free: Unknown memory\n");
+}
+
+/* True if mem points inside a memory-mapped spectrum. */
+bool SM_isOnDisk(const mammut_float *mem){
+  struct SM_Mem *sm;
+  bool ret=false;
+
+  SM_LOCK();
+  for(sm=mems;sm!=NULL;sm=sm->next)
+    if(sm->ondisk && mem>=sm->mem && (const char*)mem<(const char*)sm->mem+sm->size)
+      ret=true;
+  SM_UNLOCK();
+
+  return ret;
+}
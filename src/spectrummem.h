@@ -0,0 +1,10 @@
+
+/* Memory for the spectrum (lyd, and the temporary copies some operations
+   need) and the rendered sound. Spectra which do not fit in ram are kept
+   in memory-mapped files in TEMPDIR. */
+
+extern LANGSPEC mammut_float *SM_alloc(long num);
+extern LANGSPEC void *SM_allocBytes(size_t size);
+extern LANGSPEC mammut_float *SM_mapFile(int fd,long offset,long num);
+extern LANGSPEC void SM_free(void *mem);
+extern LANGSPEC bool SM_isOnDisk(const mammut_float *mem);
@@ -187,6 +187,33 @@ bool TF_write(struct TempFile *tf,void *source,size_t size1,size_t size2){
   return true;
 }
 
+static bool TF_seek(struct TempFile *tf,long offset){
+#ifdef _WIN32
+  if(fseek(tf->file,offset,SEEK_SET)==0)
+#else
+  if(fseeko(tf->file,(off_t)offset,SEEK_SET)==0)
+#endif
+    return true;
+
+  printerror("Serious error.\n\nCould not seek in temporary file \"%s\"",tf->name);
+  return false;
+}
+
+/* Like TF_read and TF_write, but at offset bytes from the start of the file.
+   Parts of a file can be written in any order, but only the parts which have
+   been written after the file was opened for writing can be read back. */
+bool TF_readAt(struct TempFile *tf,long offset,void *dest,size_t size1,size_t size2){
+  if(TF_openfile(tf,TF_READOPEN)==false || TF_seek(tf,offset)==false)
+    return false;
+  return TF_read(tf,dest,size1,size2);
+}
+
+bool TF_writeAt(struct TempFile *tf,long offset,void *source,size_t size1,size_t size2){
+  if(TF_openfile(tf,TF_WRITEOPEN)==false || TF_seek(tf,offset)==false)
+    return false;
+  return TF_write(tf,source,size1,size2);
+}
+
 struct TempFile *TF_new(char *firstname){
   char temp[5000];
   struct TempFile *tf;
@@ -18,6 +18,8 @@ extern LANGSPEC struct TempFile *TF_new(char *firstname);
 extern LANGSPEC struct TempFile *TF_makeCopy(char *firstname,struct TempFile *from);
 extern LANGSPEC bool TF_read(struct TempFile *tf,void *dest,size_t size1,size_t size2);
 extern LANGSPEC bool TF_write(struct TempFile *tf,void *source,size_t size1,size_t size2);
+extern LANGSPEC bool TF_readAt(struct TempFile *tf,long offset,void *dest,size_t size1,size_t size2);
+extern LANGSPEC bool TF_writeAt(struct TempFile *tf,long offset,void *source,size_t size1,size_t size2);
 
 //extern LANGSPEC int TF_write(struct Tempfile *tf,void *ptr,size_t size);
 //extern LANGSPEC int TF_read(struct Tempfile *tf,void *ptr,size_t size);
@@ -0,0 +1,186 @@
+
+#include "mammut.h"
+
+#include "threadpool.h"
+
+#ifndef _WIN32
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
+
+/*
+  A small pool of worker threads. TP_run(func,arg,num) splits the range [0,num) into
+  chunks, and calls func(arg,start,end) for each chunk from all the threads,
+  including the calling one. It returns when every chunk is finished.
+
+  Only one job runs at a time. If TP_run is called while another job is running
+  (for instance from inside func), the range is just processed by the calling thread.
+
+  The number of threads defaults to the number of cpus, but can be overridden
+  by setting the environment variable MAMMUT_THREADS.
+*/
+
+
+#define TP_MAXTHREADS 64
+
+static int num_threads=0;
+
+
+#ifdef _WIN32
+
+void TP_init(void){
+  num_threads=1;
+}
+
+void TP_run(void (*func)(void *arg,long start,long end),void *arg,long num){
+  if(num>0)
+    func(arg,0,num);
+}
+
+#else
+
+static pthread_mutex_t job_lock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t startcond=PTHREAD_COND_INITIALIZER;
+static pthread_cond_t donecond=PTHREAD_COND_INITIALIZER;
+
+static int num_workers=0;
+static int generation=0;
+static int start_generation[TP_MAXTHREADS];
+static int job_active=0;
+
+static void (*job_func)(void *arg,long start,long end);
+static void *job_arg;
+static long job_num;
+static long job_chunk;
+static long job_next;
+
+
+static void TP_doChunks(void){
+  for(;;){
+    long start=__sync_fetch_and_add(&job_next,job_chunk);
+    if(start>=job_num)
+      break;
+    job_func(job_arg,start,mammut_min(start+job_chunk,job_num));
+  }
+}
+
+static void *TP_worker(void *arg){
+  int workernum=(int)(long)arg;
+  int mygeneration=start_generation[workernum];
+
+  pthread_mutex_lock(&lock);
+
+  for(;;){
+    while(generation==mygeneration)
+      pthread_cond_wait(&startcond,&lock);
+    mygeneration=generation;
+    pthread_mutex_unlock(&lock);
+
+    if(workernum<num_threads-1)
+      TP_doChunks();
+
+    pthread_mutex_lock(&lock);
+    job_active--;
+    if(job_active==0)
+      pthread_cond_signal(&donecond);
+  }
+
+  return NULL;
+}
+
+static void TP_startWorkers(void){
+  pthread_mutex_lock(&job_lock);
+
+  while(num_workers<num_threads-1){
+    pthread_t thread;
+    start_generation[num_workers]=generation;
+    if(pthread_create(&thread,NULL,TP_worker,(void*)(long)num_workers)!=0){
+      fprintf(stderr,"Mammut: Could not start worker thread. Using %d threads.\n",num_workers+1);
+      num_threads=num_workers+1;
+      break;
+    }
+    pthread_detach(thread);
+    num_workers++;
+  }
+
+  pthread_mutex_unlock(&job_lock);
+}
+
+void TP_init(void){
+  char *env;
+
+  if(num_threads>0)
+    return;
+
+  env=getenv("MAMMUT_THREADS");
+  if(env!=NULL)
+    num_threads=atoi(env);
+  else
+    num_threads=sysconf(_SC_NPROCESSORS_ONLN);
+
+  if(num_threads<1)
+    num_threads=1;
+  if(num_threads>TP_MAXTHREADS)
+    num_threads=TP_MAXTHREADS;
+
+  TP_startWorkers();
+}
+
+void TP_run(void (*func)(void *arg,long start,long end),void *arg,long num){
+  if(num<=0)
+    return;
+
+  if(num_threads==0)
+    TP_init();
+
+  if(num==1 || num_threads==1 || pthread_mutex_trylock(&job_lock)!=0){
+    func(arg,0,num);
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  job_func=func;
+  job_arg=arg;
+  job_num=num;
+  job_chunk=M_MAX(1,num/(num_threads*4));
+  job_next=0;
+  job_active=num_workers;
+  generation++;
+  pthread_cond_broadcast(&startcond);
+  pthread_mutex_unlock(&lock);
+
+  TP_doChunks();
+
+  pthread_mutex_lock(&lock);
+  while(job_active>0)
+    pthread_cond_wait(&donecond,&lock);
+  pthread_mutex_unlock(&lock);
+
+  pthread_mutex_unlock(&job_lock);
+}
+
+#endif
+
+
+int TP_getNumThreads(void){
+  if(num_threads==0)
+    TP_init();
+  return num_threads;
+}
+
+void TP_setNumThreads(int num){
+  if(num_threads==0)
+    TP_init();
+  if(num<1)
+    num=1;
+  if(num>TP_MAXTHREADS)
+    num=TP_MAXTHREADS;
+#ifndef _WIN32
+  pthread_mutex_lock(&job_lock);
+  num_threads=num;
+  pthread_mutex_unlock(&job_lock);
+  TP_startWorkers();
+#endif
+}
@@ -0,0 +1,7 @@
+
+/* Worker threads used to split heavy loops (the giant fft, etc.) over all cpus. */
+
+extern LANGSPEC void TP_init(void);
+extern LANGSPEC int TP_getNumThreads(void);
+extern LANGSPEC void TP_setNumThreads(int num);
+extern LANGSPEC void TP_run(void (*func)(void *arg,long start,long end),void *arg,long num);
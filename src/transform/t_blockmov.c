@@ -1,5 +1,6 @@
 
 #include "mammut.h"
+#include "../dirty.h"
 #include <stdlib.h>
 #include <time.h>
 
@@ -48,10 +49,11 @@ void block_swap_ok(void)
 	if (s+len>=N/2) len=N/2-s-1;
 	e=s+len;
 	for (j=s; j<s+len/2; j++) {
-	  lyd2[j+j+chN]=lyd[j+j+chN]; lyd2[j+j+1+chN]=lyd[j+j+1+chN];
+	  mammut_float real=lyd[j+j+chN], imag=lyd[j+j+1+chN];
 	  lyd[j+j+chN]=lyd[j+j+len+chN]; lyd[j+j+1+chN]=lyd[j+j+len+1+chN];
-	  lyd[j+j+len+chN]=lyd2[j+j+chN]; lyd[j+j+len+1+chN]=lyd2[j+j+1+chN];
+	  lyd[j+j+len+chN]=real; lyd[j+j+len+1+chN]=imag;
 	}
+	DIRTY_add(ch,s+s,s+s+len/2*2+len);
       }
     }
 
@@ -74,15 +76,15 @@ void block_swap_ok(void)
 	if (s+len>=N/2) len=N/2-s-1;
 	len2=(len>>1)<<1;
 	for (j=s; j<s+len/2; j++) {
-	  lyd2[j+j+chN]=lyd[j+j+chN];
-	  lyd2[j+j+1+chN]=lyd[j+j+1+chN];
+	  mammut_float real=lyd[j+j+chN], imag=lyd[j+j+1+chN];
 	  
 	  lyd[j+j+chN]=lyd[j+j+len2+chN];
 	  lyd[j+j+1+chN]=lyd[j+j+len2+1+chN];
 	  
-	  lyd[j+j+len2+chN]=lyd2[j+j+chN];
-	  lyd[j+j+len2+1+chN]=lyd2[j+j+1+chN];
+	  lyd[j+j+len2+chN]=real;
+	  lyd[j+j+len2+1+chN]=imag;
 	}
+	DIRTY_add(ch,s+s,s+s+len2+len2);
       }
     }
 
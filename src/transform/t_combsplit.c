@@ -1,5 +1,6 @@
 
 #include "mammut.h"
+#include "../spectrummem.h"
 #include <stdlib.h>
 
 int combsplit_block_size_default=99;
@@ -19,13 +20,15 @@ void combsplit_ok(void)
   char *extp;
 
   int nch,nchN;
+  mammut_float *backup;
 
   GUI_aboveprogressbar(0,samps_per_frame*num);
     
   div=combsplit_block_size;
   num=combsplit_number_of_files;
   
-  for (i=0; i<samps_per_frame*N; i++) lyd2[i]=lyd[i];  
+  backup=SM_alloc(samps_per_frame*N);
+  memcpy(backup,lyd,samps_per_frame*N*sizeof(mammut_float));
 
   /* rett kanal : (i/div)%num==kanalnr */
   for (ch=0; ch<num; ch++) {
@@ -34,7 +37,7 @@ void combsplit_ok(void)
       nchN=nch*N;
       for (i=0; i<N/2; i++) {
 	if ( ((i/div)%num)==ch) {
-	  lyd[i+i+nchN]=lyd2[i+i+nchN]; lyd[i+i+1+nchN]=lyd2[i+i+1+nchN];
+	  lyd[i+i+nchN]=backup[i+i+nchN]; lyd[i+i+1+nchN]=backup[i+i+1+nchN];
 	} else { 
 	  lyd[i+i+nchN]=0.; lyd[i+i+1+nchN]=0.;
 	}  
@@ -69,17 +72,15 @@ void combsplit_ok(void)
       continue;
     }
 
-    for(nch=0;nch<samps_per_frame;nch++){
-      GUI_aboveprogressbar(ch*samps_per_frame + nch,samps_per_frame*num);
-      nchN=nch*N;
-      rfft(lyd+nchN,N/2,INVERSE);
-    }
+    GUI_aboveprogressbar(ch,num);
+    rfft_multi(lyd,N/2,samps_per_frame,INVERSE);
 
-    writesound(SaveWaveConsumer,outfile);
+    writesound(lyd,get_save_gain(lyd),SaveWaveConsumer,outfile);
     //    afCloseFile(outfile);
     sf_close(outfile);
   }
   
-  for (i=0; i<samps_per_frame*N; i++) lyd[i]=lyd2[i];
+  memcpy(lyd,backup,samps_per_frame*N*sizeof(mammut_float));
+  SM_free(backup);
 
 }
@@ -1,5 +1,6 @@
 
 #include "mammut.h"
+#include "../dirty.h"
 
 double filter_lower_cutoff_default=0.0;
 double filter_upper_cutoff_default=1000.0;
@@ -40,6 +41,7 @@ void filter_ok(void)
       fact*=sharp;
     }
     *progval=ch*2+1;
+    DIRTY_add(ch,low+low,up+up+2);
   }
 
 
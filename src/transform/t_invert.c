@@ -27,9 +27,9 @@ void invert_ok(void)
       *progval=ch*num + i;
       for (j=s; j<s+len/2; j++) {
         e=s+s+len-j-1;
-        lyd2[j+j+chN]=lyd[j+j+chN]; lyd2[j+j+1+chN]=lyd[j+j+1+chN];
+        mammut_float real=lyd[j+j+chN], imag=lyd[j+j+1+chN];
         lyd[j+j+chN]=lyd[e+e+chN]; lyd[j+j+1+chN]=-lyd[e+e+1+chN];
-        lyd[e+e+chN]=lyd2[j+j+chN]; lyd[e+e+1+chN]=-lyd2[j+j+1+chN];
+        lyd[e+e+chN]=real; lyd[e+e+1+chN]=-imag;
       }
       s+=len;
     }
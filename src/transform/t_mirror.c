@@ -18,15 +18,18 @@ void mirror_ok(void)
 
   for(ch=0;ch<samps_per_frame;ch++){
     chN=ch*N;
+    /* Bin i and bin j swap places, so it can be done in place. */
     for (i=0; i<N/2; i++) {
       *progval=chN/2+i;
       j=num+num-i;
       if ((j<N/2) && (j>=0)) {
-        lyd2[i+i+chN]=lyd[j+j+chN]; lyd2[i+i+1+chN]=-lyd[j+j+1+chN];
-        lyd2[j+j+chN]=lyd[i+i+chN]; lyd2[j+j+1+chN]=-lyd[i+i+1+chN];
-      } else { lyd2[i+i+chN]=0.; lyd2[i+i+1+chN]=0.; }
+	if (i<=j) {
+	  mammut_float real=lyd[i+i+chN], imag=lyd[i+i+1+chN];
+	  lyd[i+i+chN]=lyd[j+j+chN]; lyd[i+i+1+chN]=-lyd[j+j+1+chN];
+	  lyd[j+j+chN]=real; lyd[j+j+1+chN]=-imag;
+	}
+      } else { lyd[i+i+chN]=0.; lyd[i+i+1+chN]=0.; }
     }
-    for (i=0; i<N; i++) lyd[i+chN]=lyd2[i+chN];
   }
 
   GUI_stopprogressbar();
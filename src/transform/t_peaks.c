@@ -4,7 +4,7 @@
 void keep_peaks_ok(void)
 {
   int i;
-  double real, imag, amp, amplast, ampnext;
+  double real, imag, amp, amplast, ampnext, ampthis;
   int ch,chN;
 
   int_progval();
@@ -14,21 +14,24 @@ void keep_peaks_ok(void)
   for(ch=0;ch<samps_per_frame;ch++){
     chN=ch*N;
 
-    for (i=0; i<N; i++)
-      lyd2[i+chN]=lyd[i+chN];
+    /* Done in place. The amplitude of the previous bin is remembered
+       from before it was zeroed. */
+    amplast=lyd[chN]*lyd[chN] + lyd[1+chN]*lyd[1+chN];
 
     for (i=1; i<N/2-1; i++) {
       *progval=chN/2+i;
 
-      real=lyd2[i+i+chN]; imag=lyd2[i+i+1+chN]; amp=real*real+imag*imag;
+      real=lyd[i+i+chN]; imag=lyd[i+i+1+chN]; amp=real*real+imag*imag;
 
-      amplast=lyd2[i+i-2+chN]*lyd2[i+i-2+chN] + lyd2[i+i-1+chN]*lyd2[i+i-1+chN];
-      ampnext=lyd2[i+i+2+chN]*lyd2[i+i+2+chN] + lyd2[i+i+3+chN]*lyd2[i+i+3+chN];
+      ampthis=lyd[i+i+chN]*lyd[i+i+chN] + lyd[i+i+1+chN]*lyd[i+i+1+chN];
+      ampnext=lyd[i+i+2+chN]*lyd[i+i+2+chN] + lyd[i+i+3+chN]*lyd[i+i+3+chN];
       
       if ((amp<amplast) || (amp<ampnext)) {
         lyd[i+i+chN]=lyd[i+i+1+chN]=0.;
       } 
 
+      amplast=ampthis;
+
     }
   }
 
@@ -1,5 +1,6 @@
 
 #include "mammut.h"
+#include "../spectrummem.h"
 
 extern struct LoadStruct loadstruct;
 
@@ -10,19 +11,21 @@ void split_real_imag_ok(void)
   char extension[20]={0};
   char *extp;
   int nch,nchN;
+  mammut_float *backup;
 
   GUI_aboveprogressbar(0,samps_per_frame*2);
 
-  for (i=0; i<samps_per_frame*N; i++) lyd2[i]=lyd[i];  
+  backup=SM_alloc(samps_per_frame*N);
+  memcpy(backup,lyd,samps_per_frame*N*sizeof(mammut_float));
 
   for (ch=0; ch<2; ch++) {
     for(nch=0;nch<samps_per_frame;nch++){
       nchN=nch*N;
       for (i=0; i<N/2; i++) {
 	if (ch%2) {
-	  lyd[i+i+nchN]=0.; lyd[i+i+1+nchN]=lyd2[i+i+1+nchN];
+	  lyd[i+i+nchN]=0.; lyd[i+i+1+nchN]=backup[i+i+1+nchN];
 	} else { 
-	  lyd[i+i+nchN]=lyd2[i+i+nchN]; lyd[i+i+1+nchN]=0.;
+	  lyd[i+i+nchN]=backup[i+i+nchN]; lyd[i+i+1+nchN]=0.;
 	}  
       }
     }
@@ -55,18 +58,16 @@ void split_real_imag_ok(void)
       continue;
     }
 
-    for(nch=0;nch<samps_per_frame;nch++){
-      GUI_aboveprogressbar(ch*samps_per_frame + nch,samps_per_frame*2);
-      nchN=nch*N;
-      rfft(lyd+nchN,N/2,INVERSE);
-    }
+    GUI_aboveprogressbar(ch,2);
+    rfft_multi(lyd,N/2,samps_per_frame,INVERSE);
 
-    writesound(SaveWaveConsumer,outfile);
+    writesound(lyd,get_save_gain(lyd),SaveWaveConsumer,outfile);
 
     sf_close(outfile);
   }
   
-  for (i=0; i<samps_per_frame*N; i++) lyd[i]=lyd2[i];
+  memcpy(lyd,backup,samps_per_frame*N*sizeof(mammut_float));
+  SM_free(backup);
 
 }
 
@@ -1,5 +1,6 @@
 
 #include "mammut.h"
+#include "../spectrummem.h"
 
 double spectrumshift_shift_value_default=50;
 double spectrumshift_shift_value=50;
@@ -8,6 +9,7 @@ void spectrum_shift_ok(void)
 {
   int i, tnum, bins;
   int ch,chN;
+  mammut_float *temp=SM_alloc(N);
 
   int_progval();
 
@@ -19,17 +21,19 @@ void spectrum_shift_ok(void)
   for(ch=0;ch<samps_per_frame;ch++){
     *progval=ch*3;
     chN=ch*N;
-    for (i=0; i<N; i++) lyd2[i+chN]=0.;
+    for (i=0; i<N; i++) temp[i]=0.;
     *progval=ch*3+1;
     for (i=0; i<N/2; i++) {
       tnum=(int)(i+bins);
       if (tnum<0) tnum=0; if (tnum>=N/2) tnum=N/2-1;
-      *(lyd2+tnum+tnum+chN)=*(lyd+i+i+chN); *(lyd2+tnum+tnum+1+chN)=*(lyd+i+i+1+chN);
+      *(temp+tnum+tnum)=*(lyd+i+i+chN); *(temp+tnum+tnum+1)=*(lyd+i+i+1+chN);
     }
     *progval=ch*3+2;
-    for (i=0; i<N; i++) lyd[i+chN]=lyd2[i+chN];
+    for (i=0; i<N; i++) lyd[i+chN]=temp[i];
   }
 
+  SM_free(temp);
+
   
   GUI_stopprogressbar();
 }
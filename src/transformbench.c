@@ -0,0 +1,225 @@
+
+/*
+  Benchmark for the transforms, without the gui.
+
+  Usage: transformbench [-n log2size] [-c channels] [-s seed] [-o file] [transform ...]
+
+  Fills lyd with a random spectrum of 2^log2size values per channel
+  (default 2^22 and 2 channels), runs each transform (all of them if
+  none are named) with its default parameters, and prints the bins per
+  second, the peak memory use of the process so far, and a checksum of
+  the resulting spectrum. The random numbers are started from the same
+  seed for each transform, so the checksum only changes if the result
+  does, which can be used to check that an optimized transform gives
+  exactly the same result as before. The results are also written as
+  comma separated values to the file (default transformbench.csv).
+
+  Combsplit and split real/imag write sound files, and are not included.
+  Phaseswap and crossover need two channels.
+
+  Build with "make -f Makefile.linux transformbench".
+*/
+
+#include "mammut.h"
+
+#include <stdarg.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "spectrummem.h"
+
+
+/* The transforms are normally linked with the gui. */
+
+void GUI_aboveprogressbar(int curr,int maxvalue){}
+void GUI_startprogressbar(int minvalue,int *valtocheck,int maxvalue){}
+void GUI_stopprogressbar(void){}
+void DIRTY_add(int ch,long start,long end){}
+
+void printerror(const char *fmt, ...){
+  va_list argp;
+  va_start(argp,fmt);
+  vfprintf(stderr,fmt,argp);
+  va_end(argp);
+  fprintf(stderr,"\n");
+}
+
+void *erroralloc(size_t size){
+  void *ret=calloc(1,size);
+  if(ret==NULL){
+    fprintf(stderr,"transformbench: Could not allocate %ld bytes.\n",(long)size);
+    exit(1);
+  }
+  return ret;
+}
+
+
+struct TB_Transform{
+  const char *name;
+  void (*func)(void);
+  int channels;			/* 0 if it works for any number of channels. */
+};
+
+static struct TB_Transform transforms[]={
+  {"stretch",stretch_ok,0},
+  {"wobble",wobble_ok,0},
+  {"spectrumshift",spectrum_shift_ok,0},
+  {"multiplyphase",multiply_phase_ok,0},
+  {"derivateamp",derivate_amp_ok,0},
+  {"filter",filter_ok,0},
+  {"invert",invert_ok,0},
+  {"threshold",threshold_ok,0},
+  {"keeppeaks",keep_peaks_ok,0},
+  {"blockswap",block_swap_ok,0},
+  {"gain",gain_ok,0},
+  {"mirror",mirror_ok,0},
+  {"amplitudephase",amplitude_phase_ok,0},
+  {"phaseswap",Phaseswap,2},
+  {"crossover",crossover_ok,2},
+  {NULL,NULL,0}
+};
+
+
+static double TB_time(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static long TB_maxrss(void){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+  return usage.ru_maxrss;
+}
+
+/* The amplitudes are about the same as for a normal sound, so that
+   threshold and the others do not treat everything the same way. */
+static void TB_fill(unsigned int seed){
+  long i;
+
+  srandom(seed);
+  srand(seed);
+
+  for(i=0;i<N*samps_per_frame;i++)
+    lyd[i]=(random()/(double)RAND_MAX-0.5)*700./N;
+}
+
+/* FNV-1a of the bytes of lyd. */
+static unsigned long long TB_checksum(void){
+  unsigned long long hash=14695981039346656037ULL;
+  unsigned char *bytes=(unsigned char*)lyd;
+  size_t i;
+
+  for(i=0;i<sizeof(mammut_float)*N*samps_per_frame;i++){
+    hash^=bytes[i];
+    hash*=1099511628211ULL;
+  }
+
+  return hash;
+}
+
+static bool TB_selected(const char *name,int argc,char **argv,int first){
+  int i;
+
+  if(first>=argc)
+    return true;
+
+  for(i=first;i<argc;i++)
+    if(!strcmp(argv[i],name))
+      return true;
+
+  return false;
+}
+
+
+int main(int argc,char **argv){
+  char *filename="transformbench.csv";
+  int lg=22;
+  unsigned int seed=1;
+  int i,j;
+  struct TB_Transform *t;
+  FILE *file;
+
+  samps_per_frame=2;
+
+  for(i=1;i<argc && argv[i][0]=='-' && i+1<argc;i+=2){
+    if(!strcmp(argv[i],"-n"))
+      lg=atoi(argv[i+1]);
+    else if(!strcmp(argv[i],"-c"))
+      samps_per_frame=atoi(argv[i+1]);
+    else if(!strcmp(argv[i],"-s"))
+      seed=atoi(argv[i+1]);
+    else if(!strcmp(argv[i],"-o"))
+      filename=argv[i+1];
+    else
+      break;
+  }
+
+  if(lg<4 || lg>30 || samps_per_frame<1 || (i<argc && argv[i][0]=='-')){
+    fprintf(stderr,"Usage: transformbench [-n log2size] [-c channels] [-s seed] [-o file] [transform ...]\n");
+    return 1;
+  }
+
+  for(j=i;j<argc;j++){
+    for(t=transforms;t->name!=NULL;t++)
+      if(!strcmp(t->name,argv[j]))
+	break;
+    if(t->name==NULL){
+      fprintf(stderr,"transformbench: Unknown transform \"%s\".\n",argv[j]);
+      return 1;
+    }
+  }
+
+  file=fopen(filename,"w");
+  if(file==NULL){
+    fprintf(stderr,"transformbench: Could not open %s.\n",filename);
+    return 1;
+  }
+
+  N=1L<<lg;
+  binfreq=(float)R/N;
+  duration=(float)N/R;
+
+  lyd=SM_alloc(N*samps_per_frame);
+
+  printf("size: %ld, channels: %d, precision: %s, seed: %u\n",
+	 N,samps_per_frame,sizeof(mammut_float)==sizeof(double)?"double":"float",seed);
+  printf("%-16s %9s %12s %10s %18s\n","transform","seconds","Mbins/s","maxrss MB","checksum");
+
+  fprintf(file,"transform,size,channels,precision,seed,seconds,bins_per_second,maxrss_kb,checksum\n");
+
+  for(t=transforms;t->name!=NULL;t++){
+    double start,time;
+    unsigned long long checksum;
+    double bins=(double)samps_per_frame*N/2;
+
+    if(TB_selected(t->name,argc,argv,i)==false)
+      continue;
+    if(t->channels!=0 && t->channels!=samps_per_frame){
+      printf("%-16s needs %d channels\n",t->name,t->channels);
+      continue;
+    }
+
+    TB_fill(seed);
+
+    start=TB_time();
+    t->func();
+    time=TB_time()-start;
+
+    checksum=TB_checksum();
+
+    printf("%-16s %9.4f %12.2f %10.1f   %016llx\n",t->name,time,bins/time*1e-6,TB_maxrss()/1024.,checksum);
+    fflush(stdout);
+
+    fprintf(file,"%s,%ld,%d,%s,%u,%g,%g,%ld,%016llx\n",
+	    t->name,N,samps_per_frame,sizeof(mammut_float)==sizeof(double)?"double":"float",seed,
+	    time,bins/time,TB_maxrss(),checksum);
+    fflush(file);
+  }
+
+  fclose(file);
+
+  SM_free(lyd);
+
+  return 0;
+}
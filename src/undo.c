@@ -5,14 +5,23 @@
 //#include "play.h"
 
 #include "undo.h"
+#include "dirty.h"
 
 /*
   Undo code copied from ceres.
+
+  Undo and redo swap lyd with the file of the undo step. The file made
+  when the step is added holds the whole spectrum, but the changes made
+  after it (UNDO_spectrumChanged) often only touch some ranges of it (see
+  dirty.c). Then only those ranges are swapped, and the new file only
+  holds those ranges.
 */
 
 
 #define UNDOLYD 0
 
+#define UNDO_MAXRANGES 256
+
 struct Undo{
   struct Undo *prev;
   struct Undo *next;
@@ -20,9 +29,18 @@ struct Undo{
   int num;
 };
 
+struct Undo_range{
+  int ch;
+  long start,end;
+};
+
 struct Undo_lyd{
   struct Undo undo;
   struct TempFile *lydfile;
+  bool partial;			/* lydfile only holds the ranges. */
+  bool whole;			/* The whole spectrum must be swapped. */
+  int num_ranges;
+  struct Undo_range ranges[UNDO_MAXRANGES];
 };
 
 static struct Undo UndoRoot={0};
@@ -30,6 +48,7 @@ static struct Undo *CurrUndo=&UndoRoot;
 static int num_undos=0;
 static int undonum=0;
 static int doundo=2;
+static bool isundoing=false;
 
 bool unlimited_undo=false;
 bool enable_undo=true;
@@ -42,14 +61,17 @@ static int UNDO_getMaxNumUndos(void){
   return max_number_of_undos;
 }
 
+static void UNDO_free(struct Undo_lyd *ut){
+  TF_delete(ut->lydfile);
+  free(ut);
+}
+
 void UNDO_cleanup(void){
   while(CurrUndo->next!=NULL){
     struct Undo_lyd *ut=(struct Undo_lyd*)CurrUndo->next;
     struct Undo *temp=CurrUndo->next->next;
 
-    TF_delete(ut->lydfile);
-
-    free(ut);
+    UNDO_free(ut);
 
     CurrUndo->next=temp;
   }
@@ -109,13 +131,17 @@ char *UNDO_addLyd(void){
     return NULL;
   }
 
-  if(TF_write(undo_lyd->lydfile,lyd,N,samps_per_frame*sizeof(float))==false){
+  if(TF_write(undo_lyd->lydfile,lyd,N,samps_per_frame*sizeof(mammut_float))==false){
     printerror("Could not make undo.\n");
     TF_delete(undo_lyd->lydfile);
     free(undo_lyd);
     return "Could not make undo, problem saving data.";
   }
 
+  undo_lyd->partial=false;
+  undo_lyd->whole=false;
+  undo_lyd->num_ranges=0;
+
   undo=&undo_lyd->undo;
 
   undo->prev=CurrUndo;
@@ -124,8 +150,7 @@ char *UNDO_addLyd(void){
     struct Undo_lyd *ut=(struct Undo_lyd*)CurrUndo->next;
     struct Undo *temp=CurrUndo->next->next;
 
-    TF_delete(ut->lydfile);
-    free(ut);
+    UNDO_free(ut);
 
     CurrUndo->next=temp;
   }
@@ -143,8 +168,7 @@ char *UNDO_addLyd(void){
     struct Undo_lyd *ut=(struct Undo_lyd*)UndoRoot.next;
     struct Undo *temp=UndoRoot.next->next;
 
-    TF_delete(ut->lydfile);
-    free(ut);
+    UNDO_free(ut);
 
     num_undos--;
     UndoRoot.next=temp;
@@ -155,10 +179,49 @@ char *UNDO_addLyd(void){
 }
 
 
-static void UNDO_doInternal(void){
+/* Called by DIRTY_end when lyd has changed. The change is added to the ranges of the current undo step. */
+void UNDO_spectrumChanged(void){
+  struct Undo_lyd *ut=(struct Undo_lyd*)CurrUndo;
+  int ch,i;
+
+  if(isundoing || CurrUndo==&UndoRoot)
+    return;
+
+  // A change which was not made into an undo step (undo is off). The redo steps don't fit anymore.
+  if(CurrUndo->next!=NULL)
+    UNDO_cleanup();
+
+  if(ut->partial){
+    // Only the ranges of the last change are in the file, so this change can not be undone.
+    UNDO_Reset();
+    return;
+  }
+
+  if(DIRTY_isAll()){
+    ut->whole=true;
+    return;
+  }
+
+  for(ch=0;ch<samps_per_frame;ch++)
+    for(i=0;i<DIRTY_getNumRanges(ch);i++){
+      struct Undo_range *r=&ut->ranges[ut->num_ranges];
+      if(ut->num_ranges==UNDO_MAXRANGES){
+	ut->whole=true;
+	return;
+      }
+      r->ch=ch;
+      DIRTY_getRange(ch,i,&r->start,&r->end);
+      ut->num_ranges++;
+    }
+}
+
+/* Returns false, without changing lyd or the undo steps, if the redo could not be written. */
+static bool UNDO_doInternal(void){
   struct Undo *undo;
   struct Undo_lyd *ut;
   struct TempFile *temp;
+  bool whole;
+  int i;
   //int len;
 
   undo=CurrUndo;
@@ -166,10 +229,21 @@ static void UNDO_doInternal(void){
 
   temp=TF_new("lyd");
   if(temp==NULL)
-    return;
+    return false;
 
-  if(TF_write(temp,lyd,N,samps_per_frame*sizeof(float))==false){
-    printerror("Problem making redo\n");
+  // No ranges means that no change has been reported, so everything is swapped to be safe.
+  whole=ut->whole || ut->num_ranges==0;
+
+  if(whole){
+    if(TF_write(temp,lyd,N,samps_per_frame*sizeof(mammut_float))==false)
+      goto failed;
+  }else{
+    for(i=0;i<ut->num_ranges;i++){
+      struct Undo_range *r=&ut->ranges[i];
+      long pos=r->ch*N+r->start;
+      if(TF_writeAt(temp,pos*sizeof(mammut_float),lyd+pos,sizeof(mammut_float),r->end-r->start)==false)
+	goto failed;
+    }
   }
 
   //ut->lydfile->file=fopen(ut->lydfile->name,"rb");
@@ -177,21 +251,47 @@ static void UNDO_doInternal(void){
 
   MC_stop();
 
-  TF_read(ut->lydfile,lyd,N,sizeof(float)*samps_per_frame);
+  isundoing=true;
+  GUI_lockSpectrum();
+  DIRTY_begin();
+
+  if(whole){
+    TF_read(ut->lydfile,lyd,N,sizeof(mammut_float)*samps_per_frame);
+  }else{
+    for(i=0;i<ut->num_ranges;i++){
+      struct Undo_range *r=&ut->ranges[i];
+      long pos=r->ch*N+r->start;
+      TF_readAt(ut->lydfile,pos*sizeof(mammut_float),lyd+pos,sizeof(mammut_float),r->end-r->start);
+      DIRTY_add(r->ch,r->start,r->end);
+    }
+  }
+
+  DIRTY_end();
+  GUI_unlockSpectrum();
+  isundoing=false;
 
   TF_delete(ut->lydfile);
   ut->lydfile=temp;
+  ut->partial=!whole;
 
   CurrUndo=undo->prev;
   num_undos--;
 
+  return true;
+
+ failed:
+  // Undoing now would lose what is in lyd, since it can not be redone.
+  TF_delete(temp);
+  printerror("Problem making redo. Nothing was undone.\n");
+  return false;
 }
 
 void UNDO_do(void){
   if(UNDO_allowedUndo()==false) return;
 
 
-  UNDO_doInternal();
+  if(UNDO_doInternal()==false)
+    return;
 
   //  RedrawAll(fftsound);
   
@@ -203,11 +303,13 @@ void UNDO_do(void){
 
 }
 
-void UNDO_do_noredraw(void){
-  if(UNDO_allowedUndo()==false) return;
+/* Returns false if the undo failed. */
+bool UNDO_do_noredraw(void){
+  if(UNDO_allowedUndo()==false) return true;
 
 
-  UNDO_doInternal();
+  if(UNDO_doInternal()==false)
+    return false;
 
   //  RedrawAll(fftsound);
   
@@ -217,6 +319,7 @@ void UNDO_do_noredraw(void){
 
   //  EDIT_setUndoRedoMenues();  
 
+  return true;
 }
 
 void UNDO_redo(void){
@@ -225,7 +328,10 @@ void UNDO_redo(void){
   if(UNDO_allowedRedo()==false) return;
   
   CurrUndo=CurrUndo->next;
-  UNDO_doInternal();
+  if(UNDO_doInternal()==false){
+    CurrUndo=CurrUndo->prev;
+    return;
+  }
   CurrUndo=CurrUndo->next;
   
   num_undos+=2;
@@ -7,4 +7,5 @@ extern LANGSPEC int UNDO_getDoUndo(void);
 extern LANGSPEC void UNDO_setDoUndo(int dasdoundo);
 extern LANGSPEC bool UNDO_allowedUndo(void);
 extern LANGSPEC bool UNDO_allowedRedo(void);
-extern LANGSPEC void UNDO_do_noredraw(void);
+extern LANGSPEC bool UNDO_do_noredraw(void);
+extern LANGSPEC void UNDO_spectrumChanged(void);